@@ -76,6 +76,15 @@ struct CoreInfo {
 
   static inline Type AnyEnumType = Type::Enum(0, 0);
 
+  // seqs packed as bare payloads of a single blittable type, see ToArray
+  static inline Type AnyArrayType{{SHType::Array}};
+  static inline Type AnyVarArrayType{{SHType::ContextVar, {.contextVarTypes = AnyArrayType}}};
+  static inline Type IntArrayType = Type::ArrayOf(SHType::Int);
+  static inline Type FloatArrayType = Type::ArrayOf(SHType::Float);
+  static inline Type Float2ArrayType = Type::ArrayOf(SHType::Float2);
+  static inline Type Float3ArrayType = Type::ArrayOf(SHType::Float3);
+  static inline Type Float4ArrayType = Type::ArrayOf(SHType::Float4);
+
   static inline Type Float4x4Type{{SHType::Seq, {.seqTypes = Float4Type}, 4}};
   static inline Type Float4x4SeqType = Type::SeqOf(Float4x4Type);
   static inline Types Float4x4Types{{Float4x4Type, Float4x4SeqType}};
@@ -101,6 +110,10 @@ struct CoreInfo {
       {FloatSeqType, Float2Type, Float2SeqType, Float3Type, Float3SeqType, Float4Type, Float4SeqType}};
   static inline Types FloatVectorsOrVar{
       FloatVectors, {Float2VarType, Float2VarSeqType, Float3VarType, Float3VarSeqType, Float4VarType, Float4VarSeqType}};
+  static inline Types FloatVectorsOrArrays{FloatVectors, {Float2ArrayType, Float3ArrayType, Float4ArrayType}};
+  static inline Types FloatVectorsOrFloatSeqOrArrays{FloatVectorsOrFloatSeq, {Float2ArrayType, Float3ArrayType, Float4ArrayType}};
+  static inline Types FloatVectorsOrArraysOrVar{FloatVectorsOrVar,
+                                                {Float2ArrayType, Float3ArrayType, Float4ArrayType, AnyVarArrayType}};
 
   static inline Types IntOrNone{{IntType, NoneType}};
 
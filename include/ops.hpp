@@ -124,6 +124,9 @@ inline int cmp(const SHVar &a, const SHVar &b) {
 
 bool _seqEq(const SHVar &a, const SHVar &b);
 
+// arrays compare element by element as their inner type, the bytes past it in each payload are padding
+bool _arrayEq(const SHVar &a, const SHVar &b);
+
 bool _setEq(const SHVar &a, const SHVar &b);
 
 bool _tableEq(const SHVar &a, const SHVar &b);
@@ -279,9 +282,7 @@ ALWAYS_INLINE inline bool operator==(const SHVar &a, const SHVar &b) {
             memcmp(a.payload.bytesValue, b.payload.bytesValue, a.payload.bytesSize) == 0);
   case SHType::Array:
     return a.payload.arrayValue.len == b.payload.arrayValue.len && a.innerType == b.innerType &&
-           (a.payload.arrayValue.elements == b.payload.arrayValue.elements ||
-            memcmp(a.payload.arrayValue.elements, b.payload.arrayValue.elements,
-                   a.payload.arrayValue.len * sizeof(SHVarPayload)) == 0);
+           (a.payload.arrayValue.elements == b.payload.arrayValue.elements || _arrayEq(a, b));
   }
 
   return false;
@@ -289,6 +290,8 @@ ALWAYS_INLINE inline bool operator==(const SHVar &a, const SHVar &b) {
 
 bool _seqLess(const SHVar &a, const SHVar &b);
 
+bool _arrayLess(const SHVar &a, const SHVar &b, bool orEqual);
+
 bool _tableLess(const SHVar &a, const SHVar &b);
 
 // avoid trying to be smart with SIMDs here
@@ -373,9 +376,7 @@ ALWAYS_INLINE inline bool operator<(const SHVar &a, const SHVar &b) {
   case Array: {
     if (a.payload.arrayValue.elements == b.payload.arrayValue.elements && a.payload.arrayValue.len == b.payload.arrayValue.len)
       return false;
-    std::string_view abuf((const char *)a.payload.arrayValue.elements, a.payload.arrayValue.len * sizeof(SHVarPayload));
-    std::string_view bbuf((const char *)b.payload.arrayValue.elements, b.payload.arrayValue.len * sizeof(SHVarPayload));
-    return abuf < bbuf;
+    return _arrayLess(a, b, false);
   }
   default:
     throw shards::InvalidVarTypeError("Comparison operator < not supported for the given type: " + type2Name(a.valueType));
@@ -457,9 +458,7 @@ ALWAYS_INLINE inline bool operator<=(const SHVar &a, const SHVar &b) {
   case Array: {
     if (a.payload.arrayValue.elements == b.payload.arrayValue.elements && a.payload.arrayValue.len == b.payload.arrayValue.len)
       return true;
-    std::string_view abuf((const char *)a.payload.arrayValue.elements, a.payload.arrayValue.len * sizeof(SHVarPayload));
-    std::string_view bbuf((const char *)b.payload.arrayValue.elements, b.payload.arrayValue.len * sizeof(SHVarPayload));
-    return abuf <= bbuf;
+    return _arrayLess(a, b, true);
   }
   default:
     throw shards::InvalidVarTypeError("Comparison operator <= not supported for the given type: " + type2Name(a.valueType));
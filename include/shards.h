@@ -129,6 +129,9 @@ enum SHInlineShards : uint32_t {
   MathFloor,
   MathTrunc,
   MathRound,
+
+  // superinstructions of compiled wires
+  FusedGetAddUpdate,
 };
 #else
 typedef uint8_t SHType;
@@ -627,6 +630,9 @@ struct SHVarPayload {
 // this marks a variable external and even if references are counted
 // it won't be destroyed automatically
 #define SHVAR_FLAGS_EXTERNAL (1 << 2)
+// the payload memory is a view into a buffer owned elsewhere
+// (see BorrowingReader), it must not be freed or written to
+#define SHVAR_FLAGS_BORROWED (1 << 3)
 
 struct SHVar {
   struct SHVarPayload payload;
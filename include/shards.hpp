@@ -94,6 +94,12 @@ struct Type {
     return res;
   }
 
+  static Type ArrayOf(SHType innerType) {
+    Type res;
+    res._type = {SHType::Array, {}, 0, innerType};
+    return res;
+  }
+
   static Type VariableOf(SHTypesInfo types) {
     Type res;
     res._type = {SHType::ContextVar, {.contextVarTypes = types}};
@@ -1084,6 +1090,7 @@ public:
 
   Wire &looped(bool looped);
   Wire &unsafe(bool unsafe);
+  Wire &compiled(bool compiled);
   Wire &stackSize(size_t size);
   Wire &name(std::string_view name);
 
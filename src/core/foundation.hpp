@@ -138,12 +138,25 @@ SHWireState activateShards(Shards shards, SHContext *context, const SHVar &wireI
 SHWireState activateShards2(Shards shards, SHContext *context, const SHVar &wireInput, SHVar &output, SHVar &outHash) noexcept;
 SHVar *referenceGlobalVariable(SHContext *ctx, const char *name);
 SHVar *referenceVariable(SHContext *ctx, const char *name);
+// A variable name mapped to a dense index in a wire, see SHWire::variableSlot.
+// Shards keep it from compose (or their first warmup) so that warming up a wire
+// resolves each distinct name once instead of once per shard.
+struct VariableSlot {
+  SHWire *wire{nullptr};
+  uint32_t index{0};
+};
+// like referenceVariable(ctx, name), slot is (re)assigned if it belongs to another wire
+SHVar *referenceVariable(SHContext *ctx, VariableSlot &slot, const char *name);
+VariableSlot composeVariableSlot(SHWire *wire, const char *name);
 SHVar *referenceWireVariable(SHWire *wire, const char *name);
 void releaseVariable(SHVar *variable);
 void setSharedVariable(const char *name, const SHVar &value);
 void unsetSharedVariable(const char *name);
 SHVar getSharedVariable(const char *name);
 SHWireState suspend(SHContext *context, double seconds);
+// Suspends the flow until SHMesh::wake is called on it, see channels.
+// Flows not scheduled directly on a mesh (e.g. stepped wires) are suspended for a frame instead.
+SHWireState park(SHContext *context);
 void registerEnumType(int32_t vendorId, int32_t enumId, SHEnumInfo info);
 
 Shard *createShard(std::string_view name);
@@ -255,19 +268,91 @@ struct TypeInfo {
 private:
   SHTypeInfo _info{};
 };
+
+// Call tree of a profiled wire, nodes are shard instances (see SHMesh::setProfiling).
+// Times are in nanoseconds and exclude the time the wire spent suspended.
+struct ProfileNode {
+  std::string name;
+  uint32_t position{0};
+  uint64_t calls{0};
+  int64_t inclusive{0};
+  // part of inclusive spent in nested shards
+  int64_t nested{0};
+  std::unordered_map<const Shard *, std::unique_ptr<ProfileNode>> nodes;
+
+  int64_t exclusive() const { return inclusive - nested; }
+
+  ProfileNode &child(Shard *shard, uint32_t index) {
+    auto &node = nodes[shard];
+    if (unlikely(!node)) {
+      node = std::make_unique<ProfileNode>();
+      node->name = shard->name(shard);
+      node->position = index;
+    }
+    return *node;
+  }
+};
 } // namespace shards
 
 #ifndef __EMSCRIPTEN__
+namespace shards {
+// Process wide pool of coroutine stacks, bucketed by (page rounded) size.
+// Stacks are mapped with a guard page below them and recycled when wires stop.
+// Each guarded stack costs two memory mappings (the stack and its guard) and Linux caps a process
+// to vm.max_map_count (65530 by default), so past guardedLimit() stacks are carved out of unguarded
+// slabs of SlabStacks stacks sharing one mapping, those are never unmapped but always recycled.
+// Cached stacks are kept zeroed so usage can be measured by scanning up from the bottom.
+struct CoroStackPool {
+  // guarded stacks kept per size bucket, the rest gets unmapped
+  static constexpr size_t MaxCachedPerBucket = 256;
+  // guarded stacks mapped at once by default, about half of the default map count
+  static constexpr size_t DefaultGuardedLimit = 16384;
+  static constexpr size_t SlabStacks = 64;
+
+  struct Stats {
+    size_t mapped{0};    // stacks currently mapped, both in use and cached
+    size_t acquired{0};  // total acquire calls
+    size_t recycled{0};  // acquire calls served from the cache
+    size_t cached{0};    // stacks currently waiting in the cache
+    size_t unguarded{0}; // stacks carved out of slabs, both in use and cached
+    size_t maxUsage{0};  // biggest high-water mark ever measured
+  };
+
+  static CoroStackPool &instance();
+
+  boost::context::stack_context acquire(size_t size);
+  // returns the high-water mark of the stack (bytes used)
+  size_t release(boost::context::stack_context &sctx);
+
+  // how many guarded stacks can be mapped at once before falling back to slabs, 0 never guards
+  // also set by the SHARDS_GUARDED_STACKS environment variable
+  void setGuardedLimit(size_t limit);
+  size_t guardedLimit();
+
+  Stats stats();
+
+private:
+  CoroStackPool();
+
+  std::mutex _mutex;
+  std::unordered_map<size_t, std::vector<uint8_t *>> _buckets;     // usable size -> guarded stack tops
+  std::unordered_map<size_t, std::vector<uint8_t *>> _slabBuckets; // usable size -> slab stack tops
+  std::unordered_set<uint8_t *> _slabStacks;                       // tops of every slab stack
+  size_t _guarded{0};
+  size_t _guardedLimit{DefaultGuardedLimit};
+  Stats _stats;
+};
+} // namespace shards
+
 struct SHStackAllocator {
   size_t size{SH_BASE_STACK_SIZE};
-  uint8_t *mem{nullptr};
+  // optional, updated with the measured usage when the stack gets released
+  size_t *highWater{nullptr};
 
   boost::context::stack_context allocate() {
-    boost::context::stack_context ctx;
-    ctx.size = size;
-    ctx.sp = mem + size;
+    auto ctx = shards::CoroStackPool::instance().acquire(size);
 #if defined(BOOST_USE_VALGRIND)
-    ctx.valgrind_stack_id = VALGRIND_STACK_REGISTER(ctx.sp, mem);
+    ctx.valgrind_stack_id = VALGRIND_STACK_REGISTER(ctx.sp, static_cast<uint8_t *>(ctx.sp) - ctx.size);
 #endif
     return ctx;
   }
@@ -276,6 +361,9 @@ struct SHStackAllocator {
 #if defined(BOOST_USE_VALGRIND)
     VALGRIND_STACK_DEREGISTER(sctx.valgrind_stack_id);
 #endif
+    auto used = shards::CoroStackPool::instance().release(sctx);
+    if (highWater && used > *highWater)
+      *highWater = used;
   }
 };
 #endif
@@ -326,6 +414,8 @@ struct SHWire : public std::enable_shared_from_this<SHWire> {
   // Attributes
   bool looped{false};
   bool unsafe{false};
+  // fuse common shard sequences at compose, see fuseShards in runtime.cpp
+  bool compiled{false};
 
   std::string name;
 
@@ -358,6 +448,12 @@ struct SHWire : public std::enable_shared_from_this<SHWire> {
   // used in wires.cpp to store exposed/required types from compose operations
   mutable std::optional<SHComposeResult> composeResult;
 
+  // last top level compose, reused while the key matches, see ComposeCache
+  mutable uint64_t composeKey{0};
+  mutable std::vector<SHExposedTypeInfo> composedExposed;
+  mutable std::vector<SHExposedTypeInfo> composedRequired;
+  mutable bool composedFlowStopper{false};
+
   SHContext *context{nullptr};
   SHWire *resumer{nullptr}; // used in Resume/Start shards
 
@@ -371,12 +467,28 @@ struct SHWire : public std::enable_shared_from_this<SHWire> {
 
   // variables with lifetime managed externally
   std::unordered_map<std::string, SHVar *> externalVariables;
+
+  // dense index of the variable names referenced from this wire, see shards::VariableSlot
+  uint32_t variableSlot(const char *name) {
+    auto [it, inserted] = variableSlots.try_emplace(name, uint32_t(variableSlotNames.size()));
+    if (inserted)
+      variableSlotNames.push_back(&it->first);
+    return it->second;
+  }
+  std::unordered_map<std::string, uint32_t> variableSlots;
+  std::vector<const std::string *> variableSlotNames;
+  // resolved slots, only valid while warming up
+  std::vector<SHVar *> variableFrame;
+  bool variableFrameActive{false};
   // used only in the case of external variables
   std::unordered_map<uint64_t, shards::TypeInfo> typesCache;
 
-  // this is the eventual coroutine stack memory buffer
-  uint8_t *stackMem{nullptr};
   size_t stackSize{SH_BASE_STACK_SIZE};
+  // biggest amount of coroutine stack used so far, useful to tune stackSize
+  size_t stackHighWater{0};
+
+  // set when scheduled on a profiling mesh, shared with the mesh so it outlives the wire
+  std::shared_ptr<shards::ProfileNode> profile;
 
   static std::shared_ptr<SHWire> sharedFromRef(SHWireRef ref) { return *reinterpret_cast<std::shared_ptr<SHWire> *>(ref); }
 
@@ -415,8 +527,286 @@ using SHHashSet =
     std::unordered_set<OwnedVar, std::hash<SHVar>, std::equal_to<SHVar>, boost::alignment::aligned_allocator<OwnedVar, 16>>;
 using SHHashSetIt = SHHashSet::iterator;
 
-using SHMap = std::unordered_map<std::string, OwnedVar, std::hash<std::string>, std::equal_to<std::string>,
-                                 boost::alignment::aligned_allocator<std::pair<const std::string, OwnedVar>, 16>>;
+// String keyed table backing SHTable, open addressing over groups of 8 control bytes
+// (swiss table style) pointing to nodes linked in insertion order.
+// Nodes never move, pointers to values (e.g. tableAt) stay valid until their key is erased.
+// Lookups take string_views, hash(key) can be computed ahead (e.g. constant keys at compose).
+class SHMap {
+  struct Node {
+    std::pair<const std::string, OwnedVar> kv;
+    uint64_t hash;
+    Node *prev;
+    Node *next;
+
+    Node(std::string_view key, uint64_t hash) : kv(std::string(key), OwnedVar()), hash(hash), prev(nullptr), next(nullptr) {}
+  };
+
+  using NodeAllocator = boost::alignment::aligned_allocator<Node, 16>;
+
+  static constexpr size_t GroupSize = 8;
+  static constexpr uint8_t Empty = 0x80;
+  static constexpr uint8_t Deleted = 0xFE;
+  static constexpr uint64_t Lsbs = 0x0101010101010101ull;
+  static constexpr uint64_t Msbs = 0x8080808080808080ull;
+
+public:
+  template <typename NodePtr, typename Value> struct Iterator {
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<const std::string, OwnedVar>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Value *;
+    using reference = Value &;
+
+    NodePtr node{nullptr};
+
+    reference operator*() const { return node->kv; }
+    pointer operator->() const { return &node->kv; }
+    Iterator &operator++() {
+      node = node->next;
+      return *this;
+    }
+    Iterator operator++(int) {
+      auto res = *this;
+      node = node->next;
+      return res;
+    }
+    bool operator==(const Iterator &other) const { return node == other.node; }
+    bool operator!=(const Iterator &other) const { return node != other.node; }
+  };
+
+  using value_type = std::pair<const std::string, OwnedVar>;
+  using iterator = Iterator<Node *, value_type>;
+  using const_iterator = Iterator<const Node *, const value_type>;
+
+  SHMap() {}
+  SHMap(const SHMap &other) { *this = other; }
+  SHMap(SHMap &&other) noexcept { swap(other); }
+  ~SHMap() { destroy(); }
+
+  SHMap &operator=(const SHMap &other) {
+    if (this != &other) {
+      clear();
+      reserve(other._size);
+      for (auto node = other._head; node; node = node->next)
+        insert(node->kv.first, node->hash).first->second = node->kv.second;
+    }
+    return *this;
+  }
+
+  SHMap &operator=(SHMap &&other) noexcept {
+    if (this != &other) {
+      destroy();
+      swap(other);
+    }
+    return *this;
+  }
+
+  static uint64_t hash(std::string_view key) { return std::hash<std::string_view>()(key); }
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  iterator begin() { return iterator{_head}; }
+  iterator end() { return iterator{}; }
+  const_iterator begin() const { return const_iterator{_head}; }
+  const_iterator end() const { return const_iterator{}; }
+
+  iterator find(std::string_view key) { return find(key, hash(key)); }
+  iterator find(std::string_view key, uint64_t hash) { return iterator{lookup(key, hash)}; }
+  const_iterator find(std::string_view key) const { return find(key, hash(key)); }
+  const_iterator find(std::string_view key, uint64_t hash) const { return const_iterator{lookup(key, hash)}; }
+
+  size_t count(std::string_view key) const { return lookup(key, hash(key)) ? 1 : 0; }
+
+  OwnedVar &operator[](std::string_view key) { return insert(key, hash(key)).first->second; }
+
+  template <typename V> std::pair<iterator, bool> emplace(std::string_view key, V &&value) {
+    auto res = insert(key, hash(key));
+    if (res.second)
+      res.first->second = std::forward<V>(value);
+    return res;
+  }
+
+  // inserts an empty value if the key is missing
+  std::pair<iterator, bool> insert(std::string_view key, uint64_t hash) {
+    if (auto node = lookup(key, hash))
+      return {iterator{node}, false};
+
+    if ((_size + _deleted + 1) * 8 > capacity() * 7)
+      rehash(std::max(GroupSize, (_size + 1) * 2));
+
+    auto slot = findFree(hash);
+    if (_ctrl[slot] == Deleted)
+      _deleted--;
+    _ctrl[slot] = h2(hash);
+
+    NodeAllocator allocator;
+    auto node = allocator.allocate(1);
+    new (node) Node(key, hash);
+    _slots[slot] = node;
+    node->prev = _tail;
+    if (_tail)
+      _tail->next = node;
+    else
+      _head = node;
+    _tail = node;
+    _size++;
+    return {iterator{node}, true};
+  }
+
+  size_t erase(std::string_view key) {
+    auto h = hash(key);
+    auto slot = lookupSlot(key, h);
+    if (slot == capacity())
+      return 0;
+
+    auto node = _slots[slot];
+    _ctrl[slot] = Deleted;
+    _slots[slot] = nullptr;
+    _deleted++;
+    if (node->prev)
+      node->prev->next = node->next;
+    else
+      _head = node->next;
+    if (node->next)
+      node->next->prev = node->prev;
+    else
+      _tail = node->prev;
+    freeNode(node);
+    _size--;
+    return 1;
+  }
+
+  void clear() {
+    for (auto node = _head; node;) {
+      auto next = node->next;
+      freeNode(node);
+      node = next;
+    }
+    _head = _tail = nullptr;
+    _size = 0;
+    _deleted = 0;
+    std::fill(_ctrl.begin(), _ctrl.end(), Empty);
+    std::fill(_slots.begin(), _slots.end(), nullptr);
+  }
+
+  void reserve(size_t n) {
+    if (n * 8 > capacity() * 7)
+      rehash(n);
+  }
+
+  void swap(SHMap &other) noexcept {
+    std::swap(_ctrl, other._ctrl);
+    std::swap(_slots, other._slots);
+    std::swap(_head, other._head);
+    std::swap(_tail, other._tail);
+    std::swap(_size, other._size);
+    std::swap(_deleted, other._deleted);
+  }
+
+private:
+  static uint8_t h2(uint64_t hash) { return uint8_t(hash & 0x7F); }
+  // the probe sequence uses the high bits, h2 the low ones
+  static size_t h1(uint64_t hash) { return size_t(hash >> 7); }
+
+  size_t capacity() const { return _ctrl.size(); }
+
+  // byte i of the result is slot i of the group
+  uint64_t loadGroup(size_t group) const {
+    uint64_t res;
+    memcpy(&res, &_ctrl[group * GroupSize], sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    res = __builtin_bswap64(res);
+#endif
+    return res;
+  }
+
+  // high bit set in each byte of the group equal to b, might have false positives, never false negatives
+  static uint64_t matchByte(uint64_t group, uint8_t b) {
+    auto x = group ^ (Lsbs * b);
+    return (x - Lsbs) & ~x & Msbs;
+  }
+
+  static uint64_t matchEmpty(uint64_t group) { return group & ~(group << 6) & Msbs; }
+  static uint64_t matchEmptyOrDeleted(uint64_t group) { return group & ~(group << 7) & Msbs; }
+
+  static size_t firstIndex(uint64_t mask) { return size_t(__builtin_ctzll(mask)) / 8; }
+
+  // returns capacity() if not found
+  size_t lookupSlot(std::string_view key, uint64_t hash) const {
+    if (_size == 0)
+      return capacity();
+
+    const auto groups = capacity() / GroupSize;
+    auto group = h1(hash) & (groups - 1);
+    const auto tag = h2(hash);
+    // triangular probing over groups, visits each group once as their count is a power of two
+    for (size_t i = 1; i <= groups; i++) {
+      auto ctrl = loadGroup(group);
+      for (auto mask = matchByte(ctrl, tag); mask; mask &= mask - 1) {
+        auto slot = group * GroupSize + firstIndex(mask);
+        auto node = _slots[slot];
+        if (node && node->hash == hash && node->kv.first == key)
+          return slot;
+      }
+      if (matchEmpty(ctrl))
+        break;
+      group = (group + i) & (groups - 1);
+    }
+    return capacity();
+  }
+
+  Node *lookup(std::string_view key, uint64_t hash) const {
+    auto slot = lookupSlot(key, hash);
+    return slot == capacity() ? nullptr : _slots[slot];
+  }
+
+  size_t findFree(uint64_t hash) const {
+    const auto groups = capacity() / GroupSize;
+    auto group = h1(hash) & (groups - 1);
+    for (size_t i = 1;; i++) {
+      auto mask = matchEmptyOrDeleted(loadGroup(group));
+      if (mask)
+        return group * GroupSize + firstIndex(mask);
+      group = (group + i) & (groups - 1);
+    }
+  }
+
+  // rebuilds the index for at least n keys, also drops the tombstones
+  void rehash(size_t n) {
+    size_t newCapacity = GroupSize;
+    while (newCapacity * 7 < n * 8)
+      newCapacity *= 2;
+    _ctrl.assign(newCapacity, Empty);
+    _slots.assign(newCapacity, nullptr);
+    _deleted = 0;
+    for (auto node = _head; node; node = node->next) {
+      auto slot = findFree(node->hash);
+      _ctrl[slot] = h2(node->hash);
+      _slots[slot] = node;
+    }
+  }
+
+  static void freeNode(Node *node) {
+    node->~Node();
+    NodeAllocator allocator;
+    allocator.deallocate(node, 1);
+  }
+
+  void destroy() {
+    clear();
+    _ctrl.clear();
+    _slots.clear();
+  }
+
+  std::vector<uint8_t> _ctrl;
+  std::vector<Node *> _slots;
+  Node *_head{nullptr};
+  Node *_tail{nullptr};
+  size_t _size{0};
+  size_t _deleted{0};
+};
+
 using SHMapIt = SHMap::iterator;
 
 struct Globals {
@@ -842,6 +1232,14 @@ namespace shards {
 NO_INLINE void _destroyVarSlow(SHVar &var);
 NO_INLINE void _cloneVarSlow(SHVar &dst, const SHVar &src);
 
+// String payload storage, short strings are recycled through per thread size
+// classes instead of hitting the heap. capacity is set to the usable chars,
+// the 0 terminator excluded, and must be passed back when freeing.
+char *allocString(uint32_t len, uint32_t &capacity);
+void freeString(const char *str, uint32_t capacity);
+
+inline void destroyString(SHVar &var) { freeString(var.payload.stringValue, var.payload.stringCapacity); }
+
 ALWAYS_INLINE inline void destroyVar(SHVar &var) {
   switch (var.valueType) {
   case Table:
@@ -852,7 +1250,7 @@ ALWAYS_INLINE inline void destroyVar(SHVar &var) {
   case SHType::Path:
   case SHType::String:
   case ContextVar:
-    delete[] var.payload.stringValue;
+    destroyString(var);
     break;
   case Image:
     delete[] var.payload.imageValue.data;
@@ -227,6 +227,8 @@ std::ostream &operator<<(std::ostream &os, const SHTypeInfo &t) {
       }
     }
     os << "]";
+  } else if (t.basicType == SHType::Array) {
+    os << " of " << type2Name(t.innerType);
   } else if (t.basicType == SHType::Set) {
     os << " [";
     for (uint32_t i = 0; i < t.setTypes.len; i++) {
@@ -313,6 +315,20 @@ bool _seqEq(const SHVar &a, const SHVar &b) {
   return true;
 }
 
+bool _arrayEq(const SHVar &a, const SHVar &b) {
+  SHVar suba{}, subb{};
+  suba.valueType = a.innerType;
+  subb.valueType = b.innerType;
+  for (uint32_t i = 0; i < a.payload.arrayValue.len; i++) {
+    suba.payload = a.payload.arrayValue.elements[i];
+    subb.payload = b.payload.arrayValue.elements[i];
+    if (suba != subb)
+      return false;
+  }
+
+  return true;
+}
+
 bool _setEq(const SHVar &a, const SHVar &b) {
   auto &ta = a.payload.setValue;
   auto &tb = b.payload.setValue;
@@ -379,6 +395,30 @@ bool _seqLess(const SHVar &a, const SHVar &b) {
     return false;
 }
 
+bool _arrayLess(const SHVar &a, const SHVar &b, bool orEqual) {
+  if (a.innerType != b.innerType)
+    return a.innerType < b.innerType;
+
+  auto alen = a.payload.arrayValue.len;
+  auto blen = b.payload.arrayValue.len;
+  auto len = std::min(alen, blen);
+
+  SHVar suba{}, subb{};
+  suba.valueType = a.innerType;
+  subb.valueType = b.innerType;
+  for (uint32_t i = 0; i < len; i++) {
+    suba.payload = a.payload.arrayValue.elements[i];
+    subb.payload = b.payload.arrayValue.elements[i];
+    auto c = cmp(suba, subb);
+    if (c < 0)
+      return true;
+    else if (c > 0)
+      return false;
+  }
+
+  return orEqual ? alen <= blen : alen < blen;
+}
+
 bool _tableLess(const SHVar &a, const SHVar &b) {
   auto &ta = a.payload.tableValue;
   auto &tb = b.payload.tableValue;
@@ -478,6 +518,8 @@ bool operator==(const SHTypeInfo &a, const SHTypeInfo &b) {
     if (a.enumeration.vendorId != b.enumeration.vendorId)
       return false;
     return a.enumeration.typeId == b.enumeration.typeId;
+  case SHType::Array:
+    return a.innerType == b.innerType;
   case SHType::Seq: {
     if (a.seqTypes.elements == nullptr && b.seqTypes.elements == nullptr)
       return true;
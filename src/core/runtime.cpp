@@ -7,11 +7,19 @@
 #include <boost/asio/thread_pool.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/stacktrace.hpp>
+#include <condition_variable>
 #include <csignal>
 #include <cstdarg>
+#include <fstream>
 #include <pdqsort.h>
 #include <set>
+#include <shared_mutex>
 #include <string.h>
+#include <thread>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include <unordered_set>
 #include <log/log.hpp>
 
@@ -534,6 +542,7 @@ SHVar *referenceGlobalVariable(SHContext *ctx, const char *name) {
   auto mesh = ctx->main->mesh.lock();
   assert(mesh);
 
+  std::scoped_lock lock(mesh->variablesMutex);
   SHVar &v = mesh->variables[name];
   v.refcount++;
   if (v.refcount == 1) {
@@ -573,6 +582,8 @@ SHVar *referenceVariable(SHContext *ctx, const char *name) {
   auto mesh = ctx->main->mesh.lock();
   assert(mesh);
 
+  std::unique_lock lock(mesh->variablesMutex);
+
   // Was not in wires.. find in mesh
   {
     auto it = mesh->variables.find(name);
@@ -598,6 +609,8 @@ SHVar *referenceVariable(SHContext *ctx, const char *name) {
     }
   }
 
+  lock.unlock();
+
   // worst case create in current top wire!
   SHLOG_TRACE("Creating a variable, wire: {} name: {}", ctx->wireStack.back()->name, name);
   SHVar &cv = ctx->wireStack.back()->variables[name];
@@ -606,6 +619,45 @@ SHVar *referenceVariable(SHContext *ctx, const char *name) {
   return &cv;
 }
 
+VariableSlot composeVariableSlot(SHWire *wire, const char *name) {
+  if (!wire)
+    return VariableSlot{};
+  return VariableSlot{wire, wire->variableSlot(name)};
+}
+
+SHVar *referenceVariable(SHContext *ctx, VariableSlot &slot, const char *name) {
+  auto wire = ctx->currentWire();
+  // the wire might be a new one at the same address, check the name too
+  if (slot.wire != wire || slot.index >= wire->variableSlotNames.size() || *wire->variableSlotNames[slot.index] != name) {
+    slot.wire = wire;
+    slot.index = wire->variableSlot(name);
+  }
+
+  // outside of warmup there is nothing to share
+  if (!wire->variableFrameActive)
+    return referenceVariable(ctx, name);
+
+  auto &frame = wire->variableFrame;
+  if (slot.index >= frame.size())
+    frame.resize(slot.index + 1, nullptr);
+
+  auto cached = frame[slot.index];
+  if (cached) {
+    if ((cached->flags & SHVAR_FLAGS_EXTERNAL) == 0) {
+      // might be a mesh variable, wires on other workers reference those too
+      auto mesh = ctx->main->mesh.lock();
+      assert(mesh);
+      std::scoped_lock lock(mesh->variablesMutex);
+      cached->refcount++;
+    }
+    return cached;
+  }
+
+  cached = referenceVariable(ctx, name);
+  frame[slot.index] = cached;
+  return cached;
+}
+
 void releaseVariable(SHVar *variable) {
   if (!variable)
     return;
@@ -624,18 +676,9 @@ void releaseVariable(SHVar *variable) {
   }
 }
 
-SHWireState suspend(SHContext *context, double seconds) {
-  if (unlikely(!context->shouldContinue() || context->onCleanup)) {
-    throw ActivationError("Trying to suspend a terminated context!");
-  } else if (unlikely(!context->continuation)) {
-    throw ActivationError("Trying to suspend a context without coroutine!");
-  }
-
-  if (seconds <= 0) {
-    context->next = SHDuration(0);
-  } else {
-    context->next = SHClock::now().time_since_epoch() + SHDuration(seconds);
-  }
+static SHWireState yieldContext(SHContext *context) {
+  const auto profiling = context->profileNode != nullptr;
+  const auto suspendedAt = profiling ? SHClock::now() : SHClock::time_point();
 
 #ifdef SH_USE_TSAN
   auto curr = __tsan_get_current_fiber();
@@ -652,9 +695,51 @@ SHWireState suspend(SHContext *context, double seconds) {
   __tsan_switch_to_fiber(curr, 0);
 #endif
 
+  if (profiling) {
+    context->profileSuspended += std::chrono::duration_cast<std::chrono::nanoseconds>(SHClock::now() - suspendedAt).count();
+  }
+
   return context->getState();
 }
 
+SHWireState suspend(SHContext *context, double seconds) {
+  if (unlikely(!context->shouldContinue() || context->onCleanup)) {
+    throw ActivationError("Trying to suspend a terminated context!");
+  } else if (unlikely(!context->continuation)) {
+    throw ActivationError("Trying to suspend a context without coroutine!");
+  }
+
+  if (seconds <= 0) {
+    context->next = SHDuration(0);
+  } else {
+    context->next = SHClock::now().time_since_epoch() + SHDuration(seconds);
+  }
+
+  return yieldContext(context);
+}
+
+void stopped(SHWire *wire) {
+  if (auto mesh = wire->mesh.lock())
+    mesh->stopped(wire);
+}
+
+SHWireState park(SHContext *context) {
+  // only root flows are ticked by the mesh directly, others get polled by their parent
+  if (context->flow && context->flow->wire == context->main && !context->main->mesh.expired()) {
+    if (unlikely(!context->shouldContinue() || context->onCleanup)) {
+      throw ActivationError("Trying to park a terminated context!");
+    } else if (unlikely(!context->continuation)) {
+      throw ActivationError("Trying to park a context without coroutine!");
+    }
+
+    // the mesh keeps flows with this deadline aside until woken
+    context->next = SHDuration::max();
+    return yieldContext(context);
+  }
+
+  return suspend(context, 0);
+}
+
 void hash_update(const SHVar &var, void *state);
 
 std::unordered_set<const SHWire *> &gatheringWires() {
@@ -668,6 +753,24 @@ std::unordered_set<const SHWire *> &gatheringWires() {
 #endif
 }
 
+// kept out of line, the loop below only pays a branch when not profiling
+NO_INLINE static SHVar activateProfiled(ShardPtr blk, size_t position, SHContext *context, const SHVar &input) {
+  auto parent = context->profileNode;
+  auto &node = parent->child(blk, uint32_t(position));
+  context->profileNode = &node;
+  const auto suspended = context->profileSuspended;
+  const auto start = SHClock::now();
+  DEFER({
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(SHClock::now() - start).count() -
+                         (context->profileSuspended - suspended);
+    node.calls++;
+    node.inclusive += elapsed;
+    parent->nested += elapsed;
+    context->profileNode = parent;
+  });
+  return activateShard(blk, context, input);
+}
+
 template <typename T, bool HANDLES_RETURN, bool HASHED>
 ALWAYS_INLINE SHWireState shardsActivation(T &shards, SHContext *context, const SHVar &wireInput, SHVar &output,
                                            SHVar *outHash = nullptr) noexcept {
@@ -731,6 +834,8 @@ ALWAYS_INLINE SHWireState shardsActivation(T &shards, SHContext *context, const
       output = activateShard(blk, context, input);
       SHLOG_TRACE("Hashing output {}", output);
       hash_update(output, &hashState);
+    } else if (unlikely(context->profileNode != nullptr)) {
+      output = activateProfiled(blk, i, context, input);
     } else {
       output = activateShard(blk, context, input);
     }
@@ -793,6 +898,45 @@ SHWireState activateShards2(Shards shards, SHContext *context, const SHVar &wire
 // https://docs.microsoft.com/en-us/windows/win32/dlls/dynamic-link-library-best-practices?redirectedfrom=MSDN
 Shared<boost::asio::thread_pool, SharedThreadPoolConcurrency> SharedThreadPool{};
 
+namespace Math {
+void parallelFor(size_t len, const std::function<void(size_t, size_t)> &f, size_t minChunk) {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+  f(0, len);
+#else
+  minChunk = std::max<size_t>(1, minChunk);
+  const size_t chunks = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), (len + minChunk - 1) / minChunk);
+  if (chunks <= 1) {
+    f(0, len);
+    return;
+  }
+
+  // shared with the posted tasks, a task that starts late finds no chunks left and never touches f
+  struct Job {
+    std::atomic_size_t next{0};
+    std::atomic_size_t done{0};
+  };
+  auto job = std::make_shared<Job>();
+  const size_t chunkSize = (len + chunks - 1) / chunks;
+  auto work = [job, chunks, chunkSize, len, &f]() {
+    size_t chunk;
+    while ((chunk = job->next.fetch_add(1)) < chunks) {
+      const auto start = chunk * chunkSize;
+      f(start, std::min(len, start + chunkSize));
+      job->done.fetch_add(1, std::memory_order_release);
+    }
+  };
+
+  for (size_t i = 1; i < chunks; i++) {
+    boost::asio::post(SharedThreadPool(), work);
+  }
+  work();
+  while (job->done.load(std::memory_order_acquire) < chunks) {
+    std::this_thread::yield();
+  }
+#endif
+}
+} // namespace Math
+
 bool matchTypes(const SHTypeInfo &inputType, const SHTypeInfo &receiverType, bool isParameter, bool strict) {
   if (receiverType.basicType == SHType::Any)
     return true;
@@ -820,6 +964,13 @@ bool matchTypes(const SHTypeInfo &inputType, const SHTypeInfo &receiverType, boo
     }
     break;
   }
+  case SHType::Array: {
+    // a receiver without inner type takes any array
+    if (receiverType.innerType != SHType::None && inputType.innerType != receiverType.innerType) {
+      return false;
+    }
+    break;
+  }
   case Seq: {
     if (strict) {
       if (inputType.seqTypes.len > 0 && receiverType.seqTypes.len > 0) {
@@ -965,17 +1116,23 @@ struct ValidationContext {
   void *userData{};
 
   bool onWorkerThread{false};
+  // the same structure already validated with the same inputs, see ComposeCache
+  bool trusted{false};
 
   std::unordered_map<std::string_view, SHExposedTypeInfo> *fullRequired{nullptr};
 };
 
+// set right before composing the shards of a wire found in the ComposeCache,
+// consumed by that compose only so nested wires still validate
+thread_local bool composeTrusted{false};
+
 void validateConnection(ValidationContext &ctx) {
   auto previousOutput = ctx.previousOutputType;
 
   auto inputInfos = ctx.bottom->inputTypes(ctx.bottom);
   auto inputMatches = false;
   // validate our generic input
-  if (inputInfos.len == 1 && inputInfos.elements[0].basicType == None) {
+  if (ctx.trusted || (inputInfos.len == 1 && inputInfos.elements[0].basicType == None)) {
     // in this case a None always matches
     inputMatches = true;
   } else {
@@ -1094,7 +1251,9 @@ void validateConnection(ValidationContext &ctx) {
     ctx.exposed[name].emplace(exposed_param);
 
     // Reference mutability checks
-    if (strcmp(ctx.bottom->name(ctx.bottom), "Ref") == 0) {
+    if (ctx.trusted) {
+      continue;
+    } else if (strcmp(ctx.bottom->name(ctx.bottom), "Ref") == 0) {
       // make sure we are not Ref-ing a Set
       // meaning target would be overwritten, yet Set will try to deallocate
       // it/manage it
@@ -1178,7 +1337,13 @@ void validateConnection(ValidationContext &ctx) {
         // Warning only, delegate compose to decide
         ctx.cb(ctx.bottom, err.c_str(), true, ctx.userData);
       } else {
+        if (ctx.trusted && required.second.size() == 1) {
+          // type matched last time, nothing else to choose from
+          matching = true;
+        }
         for (auto type : findIt->second) {
+          if (matching)
+            break;
           auto exposedType = type.exposedType;
           auto requiredType = required_param.exposedType;
           // Finally deep compare types
@@ -1222,6 +1387,37 @@ void validateConnection(ValidationContext &ctx) {
   }
 }
 
+// Compiled wires replace common shard sequences with a single activation (superinstructions).
+// This only arms the fusion, shards switch to it once runtime types are known.
+static void fuseShards(const std::vector<Shard *> &wire) {
+  for (size_t i = 0; i + 2 < wire.size(); i++) {
+    auto get = wire[i];
+    auto add = wire[i + 1];
+    auto update = wire[i + 2];
+    if (strcmp(get->name(get), "Get") != 0 || strcmp(add->name(add), "Math.Add") != 0 ||
+        strcmp(update->name(update), "Update") != 0)
+      continue;
+
+    auto &getShard = reinterpret_cast<GetRuntime *>(get)->core;
+    auto &addShard = reinterpret_cast<Math::AddRuntime *>(add)->core;
+    auto &updateShard = reinterpret_cast<UpdateRuntime *>(update)->core;
+    if (getShard._isTable || getShard._defaultValue.valueType != SHType::None)
+      continue;
+    if (updateShard._isTable || updateShard._name != getShard._name || updateShard._global != getShard._global)
+      continue;
+    if (addShard._opType != Math::BinaryBase::Normal || addShard._operand.isVariable())
+      continue;
+
+    SHVar operand = addShard._operand;
+    if (operand.valueType != SHType::Int && operand.valueType != SHType::Float)
+      continue;
+
+    SHLOG_TRACE("Fusing Get/Math.Add/Update on variable: {}", getShard._name);
+    getShard.fuse(add, operand, update);
+    i += 2;
+  }
+}
+
 SHComposeResult composeWire(const std::vector<Shard *> &wire, SHValidationCallback callback, void *userData,
                             SHInstanceData data) {
   ValidationContext ctx{};
@@ -1231,6 +1427,7 @@ SHComposeResult composeWire(const std::vector<Shard *> &wire, SHValidationCallba
   ctx.wire = data.wire;
   ctx.userData = userData;
   ctx.onWorkerThread = data.onWorkerThread;
+  ctx.trusted = std::exchange(composeTrusted, false);
   ctx.fullRequired = reinterpret_cast<decltype(ValidationContext::fullRequired)>(data.requiredVariables);
 
   // add externally added variables
@@ -1279,6 +1476,10 @@ SHComposeResult composeWire(const std::vector<Shard *> &wire, SHValidationCallba
     }
   }
 
+  if (ctx.wire && ctx.wire->compiled) {
+    fuseShards(wire);
+  }
+
   SHComposeResult result = {ctx.previousOutputType};
 
   for (auto &exposed : ctx.exposed) {
@@ -1309,6 +1510,165 @@ SHComposeResult composeWire(const std::vector<Shard *> &wire, SHValidationCallba
   return result;
 }
 
+namespace {
+struct ComposeCacheStorage {
+  // keys of composes that went through without errors or warnings
+  std::shared_mutex mutex;
+  std::unordered_set<uint64_t> validated;
+  // bumped to invalidate the memos kept on wires
+  std::atomic<uint64_t> epoch{1};
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> memoized{0};
+};
+
+ComposeCacheStorage &composeCache() {
+  static ComposeCacheStorage cache;
+  return cache;
+}
+
+// > 0 while composing inside another compose, nested wires are neither memoized nor trusted as their
+// types can depend on the wire around them beyond what the key covers
+thread_local int composeDepth{0};
+
+void composeKeyUpdate(XXH3_state_s *state, const SHVar &var, std::unordered_set<const SHWire *> &visited);
+
+// what compose depends on in the shards of a wire and their parameters, nested wires included.
+// Only structure goes in, no wire or shard addresses, so clones and identical wires share a key.
+// Blobs only contribute their type and size, their content does not change types and can be large.
+void composeKeyUpdate(XXH3_state_s *state, const SHWire *wire, std::unordered_set<const SHWire *> &visited) {
+  // recursive wires, the index of the first visit stands for the wire
+  const auto seen = visited.size();
+  if (!visited.insert(wire).second) {
+    XXH3_128bits_update(state, &seen, sizeof(seen));
+    return;
+  }
+  XXH3_128bits_update(state, &wire->compiled, sizeof(wire->compiled));
+  const auto len = wire->shards.size();
+  XXH3_128bits_update(state, &len, sizeof(len));
+  for (auto shard : wire->shards) {
+    composeKeyUpdate(state, Var(shard), visited);
+  }
+}
+
+void composeKeyUpdate(XXH3_state_s *state, const SHVar &var, std::unordered_set<const SHWire *> &visited) {
+  XXH3_128bits_update(state, &var.valueType, sizeof(var.valueType));
+  switch (var.valueType) {
+  case SHType::ShardRef: {
+    auto shard = var.payload.shardValue;
+    auto name = shard->name(shard);
+    XXH3_128bits_update(state, name, strlen(name));
+    auto params = shard->parameters(shard);
+    for (uint32_t i = 0; i < params.len; i++) {
+      composeKeyUpdate(state, shard->getParam(shard, int(i)), visited);
+    }
+  } break;
+  case SHType::Wire:
+    if (var.payload.wireValue)
+      composeKeyUpdate(state, SHWire::sharedFromRef(var.payload.wireValue).get(), visited);
+    break;
+  case SHType::Seq:
+    for (uint32_t i = 0; i < var.payload.seqValue.len; i++) {
+      composeKeyUpdate(state, var.payload.seqValue.elements[i], visited);
+    }
+    break;
+  case SHType::Table:
+    ForEach(var.payload.tableValue, [&](auto key, auto &val) {
+      XXH3_128bits_update(state, key, strlen(key));
+      composeKeyUpdate(state, val, visited);
+    });
+    break;
+  case SHType::Bytes:
+    XXH3_128bits_update(state, &var.payload.bytesSize, sizeof(var.payload.bytesSize));
+    break;
+  case SHType::Image: {
+    auto image = var.payload.imageValue;
+    image.data = nullptr;
+    XXH3_128bits_update(state, &image, sizeof(image));
+  } break;
+  case SHType::Audio: {
+    auto audio = var.payload.audioValue;
+    audio.samples = nullptr;
+    XXH3_128bits_update(state, &audio, sizeof(audio));
+  } break;
+  case SHType::Array:
+    XXH3_128bits_update(state, &var.innerType, sizeof(var.innerType));
+    XXH3_128bits_update(state, &var.payload.arrayValue.len, sizeof(var.payload.arrayValue.len));
+    break;
+  case SHType::Object:
+    XXH3_128bits_update(state, &var.payload.objectVendorId, sizeof(var.payload.objectVendorId));
+    XXH3_128bits_update(state, &var.payload.objectTypeId, sizeof(var.payload.objectTypeId));
+    break;
+  default:
+    hash_update(var, state);
+    break;
+  }
+}
+
+// everything the compose of a wire depends on, 0 means don't memoize
+uint64_t composeCacheKey(const SHWire *wire, const SHInstanceData &data) {
+  XXH3_state_s state;
+  XXH3_INITSTATE(&state);
+  XXH3_128bits_reset_withSecret(&state, CUSTOM_XXH3_kSecret, XXH_SECRET_DEFAULT_SIZE);
+
+  const uint64_t epoch = composeCache().epoch;
+  XXH3_128bits_update(&state, &epoch, sizeof(epoch));
+
+  std::unordered_set<const SHWire *> visited;
+  composeKeyUpdate(&state, wire, visited);
+
+  auto inputHash = deriveTypeHash(data.inputType);
+  XXH3_128bits_update(&state, &inputHash, sizeof(uint64_t));
+  XXH3_128bits_update(&state, &data.onWorkerThread, sizeof(data.onWorkerThread));
+
+  for (uint32_t i = 0; i < data.shared.len; i++) {
+    auto &info = data.shared.elements[i];
+    XXH3_128bits_update(&state, info.name, strlen(info.name));
+    auto typeHash = deriveTypeHash(info.exposedType);
+    XXH3_128bits_update(&state, &typeHash, sizeof(uint64_t));
+    XXH3_128bits_update(&state, &info.isMutable, sizeof(info.isMutable));
+    XXH3_128bits_update(&state, &info.isProtected, sizeof(info.isProtected));
+    XXH3_128bits_update(&state, &info.isTableEntry, sizeof(info.isTableEntry));
+    XXH3_128bits_update(&state, &info.global, sizeof(info.global));
+  }
+
+  for (const auto &[name, var] : wire->externalVariables) {
+    XXH3_128bits_update(&state, name.c_str(), name.size());
+    auto typeHash = deriveTypeHash(*var);
+    XXH3_128bits_update(&state, &typeHash, sizeof(uint64_t));
+  }
+
+  const auto key = XXH3_128bits_digest(&state).low64;
+  return key ? key : 1;
+}
+
+// forwards to the real callback, remembering if validation complained at all
+struct ComposeCacheObserver {
+  SHValidationCallback callback;
+  void *userData;
+  bool issues{false};
+
+  static void observe(const Shard *errorShard, const char *errorTxt, SHBool nonfatalWarning, void *userData) {
+    auto self = reinterpret_cast<ComposeCacheObserver *>(userData);
+    self->issues = true;
+    self->callback(errorShard, errorTxt, nonfatalWarning, self->userData);
+  }
+};
+} // namespace
+
+ComposeCache::Stats ComposeCache::stats() {
+  auto &cache = composeCache();
+  std::shared_lock lock(cache.mutex);
+  return Stats{cache.hits, cache.misses, cache.memoized, cache.validated.size()};
+}
+
+void ComposeCache::clear() {
+  auto &cache = composeCache();
+  std::unique_lock lock(cache.mutex);
+  cache.validated.clear();
+  cache.epoch++;
+}
+
 SHComposeResult composeWire(const SHWire *wire, SHValidationCallback callback, void *userData, SHInstanceData data) {
   // settle input type of wire before compose
   if (wire->shards.size() > 0 && !std::any_of(wire->shards.begin(), wire->shards.end(),
@@ -1328,19 +1688,76 @@ SHComposeResult composeWire(const SHWire *wire, SHValidationCallback callback, v
     wire->inputTypeForceNone = false;
   }
 
-  auto res = composeWire(wire->shards, callback, userData, data);
+  // call composed on all shards if they have it, also when their compose was skipped
+  auto notifyComposed = [&](SHComposeResult &res) {
+    std::vector<shards::ShardInfo> allShards;
+    shards::gatherShards(wire, allShards);
+    for (auto &blk : allShards) {
+      if (blk.shard->composed)
+        blk.shard->composed(const_cast<Shard *>(blk.shard), wire, &res);
+    }
+  };
+
+  // the shards of this very wire were composed with the same inputs already and kept their state,
+  // hand out the previous result again without running any shard compose
+  auto &cache = composeCache();
+  const auto key = composeDepth == 0 ? composeCacheKey(wire, data) : 0;
+  if (key && wire->composeKey == key) {
+    cache.hits++;
+    cache.memoized++;
+    SHComposeResult res{wire->outputType};
+    for (auto &info : wire->composedExposed)
+      shards::arrayPush(res.exposedInfo, info);
+    for (auto &info : wire->composedRequired) {
+      shards::arrayPush(res.requiredInfo, info);
+      if (data.requiredVariables)
+        (*reinterpret_cast<std::unordered_map<std::string_view, SHExposedTypeInfo> *>(data.requiredVariables))[info.name] =
+            info;
+    }
+    res.flowStopper = wire->composedFlowStopper;
+    notifyComposed(res);
+    return res;
+  }
+
+  // another wire with the same structure (a doppelganger, a clone) went through already,
+  // its shards still need their compose but not the checks around them
+  auto trusted = false;
+  if (key) {
+    std::shared_lock lock(cache.mutex);
+    trusted = cache.validated.count(key) > 0;
+  }
+  if (trusted)
+    cache.hits++;
+  else
+    cache.misses++;
+
+  wire->composeKey = 0;
+  ComposeCacheObserver observer{callback, userData};
+  SHComposeResult res;
+  {
+    composeDepth++;
+    DEFER(composeDepth--);
+    composeTrusted = trusted;
+    res = composeWire(wire->shards, &ComposeCacheObserver::observe, &observer, data);
+  }
 
   // set output type
   wire->outputType = res.outputType;
 
-  std::vector<shards::ShardInfo> allShards;
-  shards::gatherShards(wire, allShards);
-  // call composed on all shards if they have it
-  for (auto &blk : allShards) {
-    if (blk.shard->composed)
-      blk.shard->composed(const_cast<Shard *>(blk.shard), wire, &res);
+  // errors throw, but some callers only log them
+  if (key && !observer.issues) {
+    if (!trusted) {
+      std::unique_lock lock(cache.mutex);
+      cache.validated.insert(key);
+    }
+    wire->composeKey = key;
+    wire->composedExposed.assign(res.exposedInfo.elements, res.exposedInfo.elements + res.exposedInfo.len);
+    wire->composedRequired.assign(res.requiredInfo.elements, res.requiredInfo.elements + res.requiredInfo.len);
+    wire->composedFlowStopper = res.flowStopper;
   }
 
+  notifyComposed(res);
+
   return res;
 }
 
@@ -1818,6 +2235,11 @@ Wire &Wire::unsafe(bool unsafe) {
   return *this;
 }
 
+Wire &Wire::compiled(bool compiled) {
+  _wire->compiled = compiled;
+  return *this;
+}
+
 Wire &Wire::stackSize(size_t stackSize) {
   _wire->stackSize = stackSize;
   return *this;
@@ -1935,6 +2357,9 @@ void run(SHWire *wire, SHFlow *flow, SHCoro *coro)
 #ifdef SH_USE_TSAN
   context.tsan_handle = wire->tsan_coro;
 #endif
+  if (wire->profile) {
+    context.profileNode = wire->profile.get();
+  }
   // also pupulate context in wire
   wire->context = &context;
 
@@ -2042,6 +2467,234 @@ Globals &GetGlobals() {
   return globals;
 }
 
+#ifndef __EMSCRIPTEN__
+static size_t pageSize() {
+#ifdef _WIN32
+  static size_t size = []() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return size_t(info.dwPageSize);
+  }();
+#else
+  static size_t size = size_t(sysconf(_SC_PAGESIZE));
+#endif
+  return size;
+}
+
+CoroStackPool &CoroStackPool::instance() {
+  // leaked on purpose, wires might be destroyed after static destructors ran
+  static CoroStackPool *pool = new CoroStackPool();
+  return *pool;
+}
+
+CoroStackPool::CoroStackPool() {
+  if (auto limit = std::getenv("SHARDS_GUARDED_STACKS")) {
+    _guardedLimit = size_t(std::strtoull(limit, nullptr, 10));
+  }
+}
+
+void CoroStackPool::setGuardedLimit(size_t limit) {
+  std::scoped_lock lock(_mutex);
+  _guardedLimit = limit;
+}
+
+size_t CoroStackPool::guardedLimit() {
+  std::scoped_lock lock(_mutex);
+  return _guardedLimit;
+}
+
+static uint8_t *mapStacks(size_t total) {
+#ifdef _WIN32
+  auto base = reinterpret_cast<uint8_t *>(VirtualAlloc(nullptr, total, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+  if (!base)
+    throw std::bad_alloc();
+#else
+  auto base = reinterpret_cast<uint8_t *>(mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (base == MAP_FAILED)
+    throw std::bad_alloc();
+#endif
+  return base;
+}
+
+boost::context::stack_context CoroStackPool::acquire(size_t size) {
+  const auto page = pageSize();
+  size = ((size + page - 1) / page) * page;
+
+  boost::context::stack_context ctx;
+  ctx.size = size;
+
+  bool guarded;
+  {
+    std::scoped_lock lock(_mutex);
+    _stats.acquired++;
+    for (auto buckets : {&_buckets, &_slabBuckets}) {
+      auto &bucket = (*buckets)[size];
+      if (!bucket.empty()) {
+        ctx.sp = bucket.back();
+        bucket.pop_back();
+        _stats.recycled++;
+        _stats.cached--;
+        return ctx;
+      }
+    }
+
+    guarded = _guarded < _guardedLimit;
+    if (guarded) {
+      _guarded++;
+      _stats.mapped++;
+    } else {
+      // no guard pages, a whole slab is one mapping and the rest of it goes in the cache
+      auto base = mapStacks(size * SlabStacks);
+      auto &bucket = _slabBuckets[size];
+      for (size_t i = 0; i < SlabStacks; i++) {
+        auto top = base + size * (i + 1);
+        _slabStacks.insert(top);
+        if (i > 0)
+          bucket.emplace_back(top);
+      }
+      _stats.mapped += SlabStacks;
+      _stats.unguarded += SlabStacks;
+      _stats.cached += SlabStacks - 1;
+      ctx.sp = base + size;
+      return ctx;
+    }
+  }
+
+  // one extra page at the bottom, overflowing will fault instead of corrupting memory
+  const auto total = size + page;
+  auto base = mapStacks(total);
+#ifdef _WIN32
+  DWORD old;
+  VirtualProtect(base, page, PAGE_NOACCESS, &old);
+#else
+  mprotect(base, page, PROT_NONE);
+#endif
+
+  ctx.sp = base + total;
+  return ctx;
+}
+
+size_t CoroStackPool::release(boost::context::stack_context &sctx) {
+  const auto page = pageSize();
+  auto top = reinterpret_cast<uint8_t *>(sctx.sp);
+  auto bottom = top - sctx.size;
+
+  // stacks are zeroed when mapped or cached and grow down, the deepest written word is the
+  // high-water mark, scanning up from the bottom does not miss frames that skipped a page
+  auto words = reinterpret_cast<const uint64_t *>(bottom);
+  const auto nwords = sctx.size / sizeof(uint64_t);
+  size_t untouched = 0;
+  while (untouched < nwords && words[untouched] == 0)
+    untouched++;
+  const auto used = sctx.size - untouched * sizeof(uint64_t);
+
+  // scrub before taking the lock, only the used part needs cleaning to keep the invariant
+  memset(top - used, 0, used);
+
+  {
+    std::scoped_lock lock(_mutex);
+    if (used > _stats.maxUsage)
+      _stats.maxUsage = used;
+
+    if (_slabStacks.count(top) > 0) {
+      _slabBuckets[sctx.size].emplace_back(top);
+      _stats.cached++;
+      return used;
+    }
+
+    auto &bucket = _buckets[sctx.size];
+    if (bucket.size() < MaxCachedPerBucket) {
+      bucket.emplace_back(top);
+      _stats.cached++;
+      return used;
+    }
+    _stats.mapped--;
+    _guarded--;
+  }
+
+#ifdef _WIN32
+  VirtualFree(bottom - page, 0, MEM_RELEASE);
+#else
+  munmap(bottom - page, sctx.size + page);
+#endif
+
+  return used;
+}
+
+CoroStackPool::Stats CoroStackPool::stats() {
+  std::scoped_lock lock(_mutex);
+  return _stats;
+}
+#endif
+
+namespace {
+// block sizes of the pooled string classes, a capacity of N uses N + 1 bytes
+constexpr std::array<uint32_t, 3> StringClasses{16, 32, 64};
+// blocks kept per class and thread, the rest goes back to the heap
+constexpr uint32_t StringPoolDepth = 1024;
+
+// plain data so it stays usable while other thread locals are destroyed,
+// free blocks are linked through their first bytes
+thread_local char *stringFreeBlocks[StringClasses.size()];
+thread_local uint32_t stringFreeCount[StringClasses.size()];
+thread_local bool stringPoolClosed;
+
+struct StringPoolCleanup {
+  ~StringPoolCleanup() {
+    stringPoolClosed = true;
+    for (size_t i = 0; i < StringClasses.size(); i++) {
+      while (stringFreeBlocks[i]) {
+        auto block = stringFreeBlocks[i];
+        stringFreeBlocks[i] = *reinterpret_cast<char **>(block);
+        delete[] block;
+      }
+      stringFreeCount[i] = 0;
+    }
+  }
+};
+thread_local StringPoolCleanup stringPoolCleanup;
+} // namespace
+
+char *allocString(uint32_t len, uint32_t &capacity) {
+  for (size_t i = 0; i < StringClasses.size(); i++) {
+    if (len < StringClasses[i]) {
+      capacity = StringClasses[i] - 1;
+      // touch the cleanup so that it gets constructed for this thread
+      (void)stringPoolCleanup;
+      if (auto block = stringFreeBlocks[i]) {
+        stringFreeBlocks[i] = *reinterpret_cast<char **>(block);
+        stringFreeCount[i]--;
+        return block;
+      }
+      return new char[StringClasses[i]];
+    }
+  }
+  capacity = len;
+  return new char[len + 1];
+}
+
+void freeString(const char *str, uint32_t capacity) {
+  if (!str)
+    return;
+
+  if (!stringPoolClosed) {
+    for (size_t i = 0; i < StringClasses.size(); i++) {
+      if (capacity + 1 == StringClasses[i]) {
+        if (stringFreeCount[i] < StringPoolDepth) {
+          auto block = const_cast<char *>(str);
+          *reinterpret_cast<char **>(block) = stringFreeBlocks[i];
+          stringFreeBlocks[i] = block;
+          stringFreeCount[i]++;
+          return;
+        }
+        break;
+      }
+    }
+  }
+
+  delete[] str;
+}
+
 NO_INLINE void _destroyVarSlow(SHVar &var) {
   switch (var.valueType) {
   case Seq: {
@@ -2095,9 +2748,7 @@ NO_INLINE void _cloneVarSlow(SHVar &dst, const SHVar &src) {
                                                                                    : uint32_t(strlen(src.payload.stringValue));
     if ((dst.valueType != String && dst.valueType != ContextVar) || dst.payload.stringCapacity < srcSize) {
       destroyVar(dst);
-      // allocate a 0 terminator too
-      dst.payload.stringValue = new char[srcSize + 1];
-      dst.payload.stringCapacity = srcSize;
+      dst.payload.stringValue = allocString(srcSize, dst.payload.stringCapacity);
     } else {
       if (src.payload.stringValue == dst.payload.stringValue)
         return;
@@ -2529,6 +3180,12 @@ void hash_update(const SHVar &var, void *state) {
 }
 
 void Serialization::varFree(SHVar &output) {
+  if ((output.flags & SHVAR_FLAGS_BORROWED) == SHVAR_FLAGS_BORROWED) {
+    // only Bytes, Image and Audio get borrowed, nothing to free
+    output.flags &= ~SHVAR_FLAGS_BORROWED;
+    return;
+  }
+
   switch (output.valueType) {
   case SHType::None:
   case SHType::EndOfBlittableTypes:
@@ -2556,7 +3213,7 @@ void Serialization::varFree(SHVar &output) {
   case SHType::Path:
   case SHType::String:
   case SHType::ContextVar: {
-    delete[] output.payload.stringValue;
+    destroyString(output);
     break;
   }
   case SHType::Seq: {
@@ -2606,6 +3263,152 @@ void Serialization::varFree(SHVar &output) {
   memset(&output, 0x0, sizeof(SHVar));
 }
 
+std::shared_ptr<SHWire> WireCloner::cloneWire(const SHWire *wire) {
+  auto it = _wires.find(wire);
+  if (it != _wires.end())
+    return it->second;
+
+  auto clone = SHWire::make(wire->name);
+  // before the shards, they might reference this very wire
+  _wires.emplace(wire, clone);
+  clone->looped = wire->looped;
+  clone->unsafe = wire->unsafe;
+  clone->compiled = wire->compiled;
+  clone->stackSize = wire->stackSize;
+  for (auto shard : wire->shards) {
+    clone->addShard(cloneShard(shard));
+  }
+  return clone;
+}
+
+Shard *WireCloner::cloneShard(Shard *shard) {
+  auto name = shard->name(shard);
+  auto blk = createShard(name);
+  if (!blk) {
+    throw SHException(fmt::format("Shard not found! name: {}", name));
+  }
+
+  try {
+    blk->setup(blk);
+
+    auto model = _defaultShards.emplace(name, std::shared_ptr<Shard>(createShard(name), [](Shard *s) { s->destroy(s); }))
+                     .first->second.get();
+    auto params = shard->parameters(shard);
+    for (uint32_t i = 0; i < params.len; i++) {
+      auto idx = int(i);
+      auto pval = shard->getParam(shard, idx);
+      if (pval != model->getParam(model, idx)) {
+        SHVar tmp{};
+        DEFER(freeValue(tmp));
+        cloneValue(tmp, pval);
+        blk->setParam(blk, idx, &tmp);
+      }
+    }
+
+    if (shard->getState) {
+      auto state = shard->getState(shard);
+      SHVar tmp{};
+      DEFER(freeValue(tmp));
+      cloneValue(tmp, state);
+      blk->setState(blk, &tmp);
+    }
+  } catch (...) {
+    blk->destroy(blk);
+    throw;
+  }
+
+  return blk;
+}
+
+bool WireCloner::hasReferences(const SHVar &var) {
+  switch (var.valueType) {
+  case SHType::ShardRef:
+  case SHType::Wire:
+  case SHType::Object:
+    return true;
+  case SHType::Seq: {
+    for (uint32_t i = 0; i < var.payload.seqValue.len; i++) {
+      if (hasReferences(var.payload.seqValue.elements[i]))
+        return true;
+    }
+    return false;
+  }
+  case SHType::Table: {
+    auto found = false;
+    ForEach(var.payload.tableValue, [&](auto key, auto &val) { found = found || hasReferences(val); });
+    return found;
+  }
+  case SHType::Set: {
+    auto found = false;
+    ForEach(var.payload.setValue, [&](auto &val) { found = found || hasReferences(val); });
+    return found;
+  }
+  default:
+    return false;
+  }
+}
+
+void WireCloner::cloneValue(SHVar &dst, const SHVar &src) {
+  switch (src.valueType) {
+  case SHType::ShardRef:
+    dst.valueType = SHType::ShardRef;
+    dst.payload.shardValue = cloneShard(src.payload.shardValue);
+    break;
+  case SHType::Wire:
+    dst.valueType = SHType::Wire;
+    dst.payload.wireValue = cloneWire(SHWire::sharedFromRef(src.payload.wireValue).get())->newRef();
+    break;
+  case SHType::Seq: {
+    dst.valueType = SHType::Seq;
+    const auto len = src.payload.seqValue.len;
+    arrayResize(dst.payload.seqValue, len);
+    // all empty first, freeValue might run on a partial copy
+    for (uint32_t i = 0; i < len; i++) {
+      dst.payload.seqValue.elements[i] = {};
+    }
+    for (uint32_t i = 0; i < len; i++) {
+      cloneValue(dst.payload.seqValue.elements[i], src.payload.seqValue.elements[i]);
+    }
+    break;
+  }
+  default:
+    if (hasReferences(src)) {
+      throw SHException("WireCloner: unsupported parameter value");
+    }
+    shards::cloneVar(dst, src);
+    break;
+  }
+}
+
+void WireCloner::freeValue(SHVar &var) {
+  switch (var.valueType) {
+  case SHType::ShardRef: {
+    auto blk = var.payload.shardValue;
+    // setParam took ownership otherwise
+    if (!blk->owned) {
+      blk->destroy(blk);
+    }
+    var = {};
+    break;
+  }
+  case SHType::Wire:
+    SHWire::deleteRef(var.payload.wireValue);
+    var = {};
+    break;
+  case SHType::Seq: {
+    for (uint32_t i = 0; i < var.payload.seqValue.len; i++) {
+      freeValue(var.payload.seqValue.elements[i]);
+    }
+    arrayFree(var.payload.seqValue);
+    var = {};
+    break;
+  }
+  default:
+    destroyVar(var);
+    break;
+  }
+}
+
 SHString getString(uint32_t crc) {
   assert(shards::GetGlobals().CompressedStrings);
   auto s = (*shards::GetGlobals().CompressedStrings)[crc].string;
@@ -2634,6 +3437,9 @@ void SHWire::reset() {
   }
   shards.clear();
 
+  variableSlots.clear();
+  variableSlotNames.clear();
+
   // find dangling variables, notice but do not destroy
   for (auto var : variables) {
     if (var.second.refcount > 0) {
@@ -2659,9 +3465,8 @@ void SHWire::reset() {
   }
   mesh.reset();
 
-  if (stackMem) {
-    ::operator delete[](stackMem, std::align_val_t{16});
-    stackMem = nullptr;
+  if (stackHighWater > 0) {
+    SHLOG_DEBUG("Wire {} stack high-water mark: {} bytes of {}", name, stackHighWater, stackSize);
   }
 
   resumer = nullptr;
@@ -2677,6 +3482,15 @@ void SHWire::warmup(SHContext *context) {
 
     context->wireStack.push_back(this);
     DEFER({ context->wireStack.pop_back(); });
+
+    // shards referencing the same variable share the lookup
+    variableFrame.assign(variableSlotNames.size(), nullptr);
+    variableFrameActive = true;
+    DEFER({
+      variableFrameActive = false;
+      variableFrame.clear();
+    });
+
     for (auto blk : shards) {
       try {
         if (blk->warmup)
@@ -2753,6 +3567,390 @@ void SHWire::cleanup(bool force) {
   }
 }
 
+namespace shards {
+// Only flows that never ticked can be stolen, once a worker ticked a flow it is the only one
+// resuming it (see SHMesh::_homes), a wire coroutine never changes thread across a yield.
+// Thread locals held across a yield so stay valid: DSP plans, scratch buffers of shards.
+// Some would be fine migrating anyway, currentWorkers/currentFlow are set before each resume and
+// pooled strings are plain heap blocks any thread can take back.
+struct MeshWorkers {
+  static constexpr uint32_t Unpinned = UINT32_MAX;
+
+  // the pool and flow currently ticking on this thread, used to pin wires
+  // scheduled from within other wires
+  static inline thread_local MeshWorkers *currentWorkers{nullptr};
+  static inline thread_local SHFlow *currentFlow{nullptr};
+  static inline thread_local uint32_t currentIndex{0};
+
+  struct Worker {
+    std::thread thread;
+    // flows only this worker can tick, wires sharing variables with others
+    std::deque<SHFlow *> pinned;
+    // flows other workers are allowed to steal from the front
+    std::mutex sharedMutex;
+    std::deque<SHFlow *> shared;
+    // flows taken from a shared deque during the last tick, the mesh makes this worker their home
+    std::vector<SHFlow *> adopted;
+    std::atomic<uint64_t> ticks{0};
+  };
+
+  MeshWorkers(uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+      workers.emplace_back(new Worker());
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      workers[i]->thread = std::thread([this, i]() { loop(i); });
+    }
+  }
+
+  ~MeshWorkers() {
+    {
+      std::scoped_lock lock(mutex);
+      quit = true;
+    }
+    startCv.notify_all();
+    for (auto &worker : workers) {
+      worker->thread.join();
+    }
+  }
+
+  // runs a full tick across all workers and returns when every flow was ticked
+  void tick(SHDuration now, const SHVar &input) {
+    {
+      std::scoped_lock lock(mutex);
+      tickNow = now;
+      tickInput = input;
+      pending = uint32_t(workers.size());
+      generation++;
+    }
+    startCv.notify_all();
+
+    std::unique_lock lock(mutex);
+    doneCv.wait(lock, [this]() { return pending == 0; });
+  }
+
+  SHFlow *next(Worker &self) {
+    if (!self.pinned.empty()) {
+      auto flow = self.pinned.back();
+      self.pinned.pop_back();
+      return flow;
+    }
+
+    {
+      std::scoped_lock lock(self.sharedMutex);
+      if (!self.shared.empty()) {
+        auto flow = self.shared.back();
+        self.shared.pop_back();
+        self.adopted.emplace_back(flow);
+        return flow;
+      }
+    }
+
+    // our deques are empty, try steal the oldest flow from someone else
+    for (auto &victim : workers) {
+      if (victim.get() == &self)
+        continue;
+
+      std::scoped_lock lock(victim->sharedMutex);
+      if (!victim->shared.empty()) {
+        auto flow = victim->shared.front();
+        victim->shared.pop_front();
+        self.adopted.emplace_back(flow);
+        return flow;
+      }
+    }
+
+    return nullptr;
+  }
+
+  void loop(uint32_t index) {
+    auto &self = *workers[index];
+    currentWorkers = this;
+    currentIndex = index;
+    uint64_t lastGeneration = 0;
+    while (true) {
+      SHDuration now;
+      SHVar input;
+      {
+        std::unique_lock lock(mutex);
+        startCv.wait(lock, [&]() { return quit || generation != lastGeneration; });
+        if (quit)
+          return;
+        lastGeneration = generation;
+        now = tickNow;
+        input = tickInput;
+      }
+
+      while (auto flow = next(self)) {
+        currentFlow = flow;
+        shards::tick(flow->wire, now, input);
+        currentFlow = nullptr;
+        self.ticks++;
+      }
+
+      {
+        std::scoped_lock lock(mutex);
+        pending--;
+      }
+      doneCv.notify_one();
+    }
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  std::mutex mutex;
+  std::condition_variable startCv;
+  std::condition_variable doneCv;
+  uint64_t generation{0};
+  uint32_t pending{0};
+  bool quit{false};
+  SHDuration tickNow{};
+  SHVar tickInput{};
+};
+} // namespace shards
+
+SHMesh::SHMesh() {
+  if (auto path = std::getenv("SHARDS_PROFILE")) {
+    _profiling = true;
+    _profilePath = path;
+  }
+}
+
+SHMesh::~SHMesh() {
+  terminate();
+  _workers.reset();
+
+  if (!_profilePath.empty() && !_profiles.empty()) {
+    // appending, flamegraph tools sum up identical stacks of different meshes
+    std::ofstream out(_profilePath, std::ios::app);
+    if (out) {
+      dumpProfile(out);
+    } else {
+      SHLOG_ERROR("Failed to write profile to: {}", _profilePath);
+    }
+  }
+}
+
+static void dumpProfileNode(std::ostream &out, const ProfileNode &node, std::string &stack, bool collapsed) {
+  std::vector<const ProfileNode *> children;
+  for (auto &[_, child] : node.nodes) {
+    children.emplace_back(child.get());
+  }
+  std::sort(children.begin(), children.end(), [](auto a, auto b) { return a->position < b->position; });
+
+  for (auto child : children) {
+    const auto size = stack.size();
+    // frames are separated by ; and values by spaces in collapsed stacks
+    std::string name = child->name;
+    std::replace(name.begin(), name.end(), ';', '_');
+    std::replace(name.begin(), name.end(), ' ', '_');
+    stack += fmt::format(";{}@{}", name, child->position);
+    if (collapsed) {
+      out << stack << " " << child->exclusive() << "\n";
+    } else {
+      out << stack << " " << child->calls << " " << child->inclusive << " " << child->exclusive() << "\n";
+    }
+    dumpProfileNode(out, *child, stack, collapsed);
+    stack.resize(size);
+  }
+}
+
+void SHMesh::dumpProfile(std::ostream &out, bool collapsed) const {
+  std::string stack;
+  for (auto &[name, root] : _profiles) {
+    stack = name;
+    std::replace(stack.begin(), stack.end(), ';', '_');
+    std::replace(stack.begin(), stack.end(), ' ', '_');
+    dumpProfileNode(out, *root, stack, collapsed);
+  }
+}
+
+void SHMesh::setWorkers(uint32_t count) {
+#ifdef __EMSCRIPTEN__
+  if (count > 0) {
+    SHLOG_WARNING("Threaded mesh is not supported on this platform, ticking on the calling thread");
+  }
+#else
+  _workers.reset();
+  if (count > 0) {
+    if (!_flows.empty()) {
+      SHLOG_WARNING("Mesh workers enabled after scheduling, already scheduled wires will share one worker");
+    }
+    _workers.reset(new shards::MeshWorkers(count));
+  }
+#endif
+}
+
+uint32_t SHMesh::workers() const { return _workers ? uint32_t(_workers->workers.size()) : 0; }
+
+std::vector<uint64_t> SHMesh::workerTicks() const {
+  std::vector<uint64_t> res;
+  if (_workers) {
+    for (auto &worker : _workers->workers) {
+      res.emplace_back(worker->ticks.load());
+    }
+  }
+  return res;
+}
+
+void SHMesh::collectSharedVariables(const SHComposeResult &result, std::vector<std::string> &out) {
+  // root wires can only require variables living in the mesh (or its refs)
+  for (uint32_t i = 0; i < result.requiredInfo.len; i++) {
+    std::string_view name(result.requiredInfo.elements[i].name);
+    // take only the first part of variable name, the rest is a table key
+    out.emplace_back(name.substr(0, name.find(' ')));
+  }
+  for (uint32_t i = 0; i < result.exposedInfo.len; i++) {
+    auto &exposed = result.exposedInfo.elements[i];
+    if (exposed.global) {
+      out.emplace_back(exposed.name);
+    }
+  }
+}
+
+uint32_t SHMesh::pinGroup(uint32_t group) {
+  while (_groupParents[group] != group) {
+    // path halving
+    _groupParents[group] = _groupParents[_groupParents[group]];
+    group = _groupParents[group];
+  }
+  return group;
+}
+
+void SHMesh::pinWire(SHWire *wire, const std::vector<std::string> *sharedVariables) {
+  if (!sharedVariables) {
+    // not composed here (Detach, Spawn etc), we don't know what it touches so
+    // keep it on the same worker as the wire scheduling it
+    SHWire *parent = nullptr;
+    if (shards::MeshWorkers::currentWorkers == _workers.get() && shards::MeshWorkers::currentFlow) {
+      parent = shards::MeshWorkers::currentFlow->wire;
+    }
+
+    auto group = shards::MeshWorkers::Unpinned;
+    if (parent) {
+      auto it = _pinnedGroups.find(parent);
+      if (it != _pinnedGroups.end())
+        group = it->second;
+    } else if (!_groupParents.empty()) {
+      // scheduled from outside, share the first group
+      group = pinGroup(0);
+    }
+
+    if (group == shards::MeshWorkers::Unpinned) {
+      if (parent) {
+        // the parent is unpinned and lives on this worker from now on, keep the child with it
+        _pinnedGroups[wire] = group;
+        _homes[wire] = shards::MeshWorkers::currentIndex;
+        return;
+      }
+      group = uint32_t(_groupParents.size());
+      _groupParents.emplace_back(group);
+    }
+    _pinnedGroups[wire] = group;
+    return;
+  }
+
+  if (sharedVariables->empty()) {
+    _pinnedGroups[wire] = shards::MeshWorkers::Unpinned;
+    return;
+  }
+
+  auto group = uint32_t(_groupParents.size());
+  _groupParents.emplace_back(group);
+  for (auto &name : *sharedVariables) {
+    auto [it, inserted] = _variableGroups.emplace(name, group);
+    if (!inserted) {
+      // union, the groups get merged and will tick on the same worker,
+      // the oldest root wins so wires already ticking keep their worker
+      auto other = pinGroup(it->second);
+      auto mine = pinGroup(group);
+      if (other != mine) {
+        _groupParents[std::max(other, mine)] = std::min(other, mine);
+      }
+    }
+  }
+  _pinnedGroups[wire] = group;
+}
+
+bool SHMesh::onWorker() const {
+  return _workers && shards::MeshWorkers::currentWorkers == _workers.get() && shards::MeshWorkers::currentFlow;
+}
+
+bool SHMesh::tickThreaded(SHVar input) {
+  auto noErrors = true;
+
+  SHDuration now = SHClock::now().time_since_epoch();
+  wakeUp(now);
+  _ticking.swap(_ready);
+
+  // distribute flows, this is the only place touching worker deques outside the tick
+  auto &workers = _workers->workers;
+  const auto nworkers = uint32_t(workers.size());
+  uint32_t roundRobin = 0;
+  for (auto &flow : _ticking) {
+    if (unlikely(!flow->wire))
+      continue;
+
+    auto it = _pinnedGroups.find(flow->wire);
+    auto group = it != _pinnedGroups.end() ? it->second : shards::MeshWorkers::Unpinned;
+    if (group == shards::MeshWorkers::Unpinned) {
+      auto home = _homes.find(flow->wire);
+      if (home != _homes.end()) {
+        workers[home->second % nworkers]->pinned.emplace_back(flow.get());
+      } else {
+        workers[roundRobin++ % nworkers]->shared.emplace_back(flow.get());
+      }
+    } else {
+      workers[pinGroup(group) % nworkers]->pinned.emplace_back(flow.get());
+    }
+  }
+
+  _workers->tick(now, input);
+
+  // flows started this tick stay on the worker that started them
+  for (uint32_t i = 0; i < nworkers; i++) {
+    for (auto flow : workers[i]->adopted) {
+      if (flow->wire)
+        _homes.emplace(flow->wire, i);
+    }
+    workers[i]->adopted.clear();
+  }
+
+  for (auto &flow : _ticking) {
+    if (unlikely(!flow->wire))
+      continue;
+
+    if (unlikely(!shards::isRunning(flow->wire))) {
+      if (flow->wire->finishedError.size() > 0) {
+        _errors.emplace_back(flow->wire->finishedError);
+      }
+      if (!shards::stop(flow->wire)) {
+        noErrors = false;
+      }
+      flow->wire->mesh.reset();
+      _pinnedGroups.erase(flow->wire);
+      _homes.erase(flow->wire);
+      _flows.erase(flow->wire);
+    } else {
+      suspended(flow, now);
+    }
+  }
+  _ticking.clear();
+
+  // workers are idle again, apply what they asked for while ticking
+  if (_deferredTerminate) {
+    terminate();
+  } else if (!_deferredRemovals.empty()) {
+    std::vector<std::shared_ptr<SHWire>> removals;
+    removals.swap(_deferredRemovals);
+    for (auto &wire : removals) {
+      remove(wire);
+    }
+  }
+
+  return noErrors;
+}
+
 #ifndef OVERRIDE_REGISTER_ALL_SHARDS
 void shRegisterAllShards() { shards::registerCoreShards(); }
 #endif
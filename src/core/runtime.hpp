@@ -18,9 +18,11 @@
 #include "foundation.hpp"
 
 #include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <list>
 #include <map>
+#include <queue>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -90,6 +92,11 @@ struct SHContext {
   void *tsan_handle = nullptr;
 #endif
 
+  // profiling only, the node of the shard being activated
+  shards::ProfileNode *profileNode{nullptr};
+  // nanoseconds spent suspended so far, excluded from profiled times
+  int64_t profileSuspended{0};
+
   SHWire *currentWire() const { return wireStack.back(); }
 
   constexpr void stopFlow(const SHVar &lastValue) {
@@ -151,6 +158,28 @@ namespace shards {
 [[nodiscard]] SHComposeResult composeWire(const SHWire *wire, SHValidationCallback callback, void *userData, SHInstanceData data);
 
 bool validateSetParam(Shard *shard, int index, const SHVar &value, SHValidationCallback callback, void *userData);
+
+// Composing a wire again (e.g. when rescheduled) with the same shards, parameters, input type,
+// shared and external variables reuses its previous result without running any shard compose,
+// shards keep their compose state between composes. A different wire with the same structure
+// (doppelgangers, clones) still runs its shard composes but skips the validation around them.
+// Keys cover everything compose depends on, so entries never need to be invalidated one by one.
+// Only wires composed at the top level are cached.
+struct ComposeCache {
+  struct Stats {
+    // composes of an already validated structure, memoized ones included
+    uint64_t hits;
+    uint64_t misses;
+    // hits that skipped every shard compose
+    uint64_t memoized;
+    size_t validated;
+  };
+
+  static Stats stats();
+  // forgets everything, call when compose depends on something outside of the key changed,
+  // e.g. shards re-registered
+  static void clear();
+};
 } // namespace shards
 
 #include "shards/core.hpp"
@@ -212,6 +241,10 @@ FLATTEN ALWAYS_INLINE inline SHVar activateShard(Shard *blk, SHContext *context,
     auto shard = reinterpret_cast<shards::SwapRuntime *>(blk);
     return shard->core.activate(context, input);
   }
+  case FusedGetAddUpdate: {
+    auto shard = reinterpret_cast<shards::GetRuntime *>(blk);
+    return shard->core.activateFusedAdd();
+  }
   default: {
     // NotInline
     return blk->activate(blk, context, &input);
@@ -235,6 +268,9 @@ boost::context::continuation run(SHWire *wire, SHFlow *flow, boost::context::con
 void run(SHWire *wire, SHFlow *flow, SHCoro *coro);
 #endif
 
+// lets the mesh ticking the wire, if any, drop its flow from the sleeping and parked ones
+void stopped(SHWire *wire);
+
 inline void prepare(SHWire *wire, SHFlow *flow) {
   if (wire->coro)
     return;
@@ -248,11 +284,9 @@ inline void prepare(SHWire *wire, SHFlow *flow) {
 #endif
 
 #ifndef __EMSCRIPTEN__
-  if (!wire->stackMem) {
-    wire->stackMem = new (std::align_val_t{16}) uint8_t[wire->stackSize];
-  }
+  // the stack comes from CoroStackPool and goes back to it once the coroutine ends
   wire->coro =
-      boost::context::callcc(std::allocator_arg, SHStackAllocator{wire->stackSize, wire->stackMem},
+      boost::context::callcc(std::allocator_arg, SHStackAllocator{wire->stackSize, &wire->stackHighWater},
                              [wire, flow](boost::context::continuation &&sink) { return run(wire, flow, std::move(sink)); });
 #else
   wire->coro.emplace(wire->stackSize);
@@ -326,6 +360,7 @@ inline bool stop(SHWire *wire, SHVar *result = nullptr) {
 
   wire->state = SHWire::State::Stopped;
   destroyVar(wire->rootTickInput);
+  stopped(wire);
 
   // Clone the results if we need them
   if (result)
@@ -429,6 +464,9 @@ struct RuntimeCallbacks {
   virtual void registerObjectType(int32_t vendorId, int32_t typeId, SHObjectInfo info) = 0;
   virtual void registerEnumType(int32_t vendorId, int32_t typeId, SHEnumInfo info) = 0;
 };
+
+// implemented in runtime.cpp, see SHMesh::setWorkers
+struct MeshWorkers;
 }; // namespace shards
 
 struct SHMesh : public std::enable_shared_from_this<SHMesh> {
@@ -436,7 +474,7 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
 
   static std::shared_ptr<SHMesh> *makePtr() { return new std::shared_ptr<SHMesh>(new SHMesh()); }
 
-  ~SHMesh() { terminate(); }
+  ~SHMesh();
 
   struct EmptyObserver {
     void before_compose(SHWire *wire) {}
@@ -450,6 +488,11 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
   void schedule(Observer observer, const std::shared_ptr<SHWire> &wire, SHVar input = shards::Var::Empty, bool compose = true) {
     SHLOG_TRACE("Scheduling wire {}", wire->name);
 
+    // wires might schedule other wires while being ticked by a worker
+    std::unique_lock<std::recursive_mutex> lock(_scheduleMutex, std::defer_lock);
+    if (_workers)
+      lock.lock();
+
     if (wire->warmedUp) {
       SHLOG_ERROR("Attempted to schedule a wire multiple times, wire: {}", wire->name);
       throw shards::SHException("Multiple wire schedule");
@@ -464,6 +507,8 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
     DEFER(wire->isRoot = false);
 
     observer.before_compose(wire.get());
+    // variables the wire shares with the mesh, used to pin it when threaded
+    std::vector<std::string> sharedVariables;
     if (compose) {
       // compose the wire
       SHInstanceData data = instanceData;
@@ -480,6 +525,9 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
             }
           },
           this, data);
+      if (_workers) {
+        collectSharedVariables(validation, sharedVariables);
+      }
       shards::arrayFree(validation.exposedInfo);
       shards::arrayFree(validation.requiredInfo);
       shards::freeDerivedInfo(data.inputType);
@@ -489,9 +537,21 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
       SHLOG_TRACE("Wire {} skipped compose", wire->name);
     }
 
+    if (_workers) {
+      pinWire(wire.get(), compose ? &sharedVariables : nullptr);
+    }
+
+    if (_profiling && !wire->profile) {
+      wire->profile = std::make_shared<shards::ProfileNode>();
+      _profiles.emplace_back(wire->name, wire->profile);
+    }
+
     observer.before_prepare(wire.get());
     // create a flow as well
-    shards::prepare(wire.get(), _flows.emplace_back(new SHFlow{wire.get()}).get());
+    auto &flow = _flows[wire.get()];
+    flow.reset(new SHFlow{wire.get()});
+    _ready.emplace_back(flow);
+    shards::prepare(wire.get(), flow.get());
     observer.before_start(wire.get());
     shards::start(wire.get(), input);
 
@@ -510,10 +570,19 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
     _errors.clear();
     if (shards::GetGlobals().SigIntTerm > 0) {
       terminate();
+    } else if (std::is_same_v<Observer, EmptyObserver> && _workers) {
+      // observers are not thread safe, so they always get the sequential path
+      noErrors = tickThreaded(input);
     } else {
       SHDuration now = SHClock::now().time_since_epoch();
-      for (auto it = _flows.begin(); it != _flows.end();) {
-        auto &flow = *it;
+      // only flows past their deadline are resumed, the rest stays asleep
+      wakeUp(now);
+      _ticking.swap(_ready);
+      for (auto &flow : _ticking) {
+        // removed while waiting
+        if (unlikely(!flow->wire))
+          continue;
+
         observer.before_tick(flow->wire);
         shards::tick(flow->wire, now, input);
         if (unlikely(!shards::isRunning(flow->wire))) {
@@ -525,11 +594,12 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
             noErrors = false;
           }
           flow->wire->mesh.reset();
-          it = _flows.erase(it);
+          _flows.erase(flow->wire);
         } else {
-          ++it;
+          suspended(flow, now);
         }
       }
+      _ticking.clear();
     }
     return noErrors;
   }
@@ -539,13 +609,41 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
     return tick(obs, input);
   }
 
+  // When called by a wire ticking on a worker the mesh is only torn down once
+  // the threaded tick ends, other workers might still be ticking its flows.
   void terminate() {
+    std::unique_lock<std::recursive_mutex> lock(_scheduleMutex, std::defer_lock);
+    if (_workers) {
+      lock.lock();
+      if (onWorker()) {
+        _deferredTerminate = true;
+        return;
+      }
+    }
+
     for (auto wire : scheduled) {
       shards::stop(wire.get());
       wire->mesh.reset();
     }
 
+    for (auto &[_, flow] : _flows) {
+      flow->wire = nullptr;
+    }
     _flows.clear();
+    _ready.clear();
+    _sleeping = {};
+    _parked.clear();
+    {
+      std::scoped_lock lock(_wakeMutex);
+      _woken.clear();
+      _stopped.clear();
+    }
+    _pinnedGroups.clear();
+    _variableGroups.clear();
+    _groupParents.clear();
+    _homes.clear();
+    _deferredRemovals.clear();
+    _deferredTerminate = false;
 
     // release all wires
     scheduled.clear();
@@ -562,9 +660,28 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
     refs.clear();
   }
 
+  // Same as terminate, from a worker the wire is stopped and removed after the threaded tick.
   void remove(const std::shared_ptr<SHWire> &wire) {
+    std::unique_lock<std::recursive_mutex> lock(_scheduleMutex, std::defer_lock);
+    if (_workers) {
+      lock.lock();
+      if (onWorker()) {
+        _deferredRemovals.emplace_back(wire);
+        return;
+      }
+    }
+
     shards::stop(wire.get());
-    _flows.remove_if([wire](auto &flow) { return flow->wire == wire.get(); });
+    auto it = _flows.find(wire.get());
+    if (it != _flows.end()) {
+      // might still be queued, tick skips flows without a wire
+      it->second->wire = nullptr;
+      if (_parked.erase(it->second.get()) == 0)
+        dropSleeping({it->second.get()}, false);
+      _flows.erase(it);
+    }
+    _pinnedGroups.erase(wire.get());
+    _homes.erase(wire.get());
     wire->mesh.reset();
     visitedWires.erase(wire.get());
     scheduled.erase(wire);
@@ -572,14 +689,90 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
 
   bool empty() { return _flows.empty(); }
 
+  // earliest time a flow needs to be resumed, 0 if some are ready already (or there are none),
+  // SHDuration::max() if every flow is parked and only a wake call can resume them.
+  // hosts can wait until then instead of ticking idle meshes, see waitForWork
+  SHDuration nextWakeUp() const {
+    if (!_ready.empty() || _flows.empty())
+      return SHDuration(0);
+    {
+      std::scoped_lock lock(_wakeMutex);
+      if (!_woken.empty() || !_stopped.empty())
+        return SHDuration(0);
+    }
+    if (_sleeping.empty())
+      return SHDuration::max();
+    return _sleeping.top().deadline;
+  }
+
+  // Thread safe, blocks until a flow is woken or stopped or the deadline (from nextWakeUp) passes.
+  void waitForWork(SHDuration deadline) const {
+    std::unique_lock lock(_wakeMutex);
+    auto pending = [this]() { return !_woken.empty() || !_stopped.empty(); };
+    if (deadline == SHDuration::max()) {
+      _wakeCv.wait(lock, pending);
+    } else {
+      _wakeCv.wait_until(lock, SHClock::time_point(std::chrono::duration_cast<SHClock::duration>(deadline)), pending);
+    }
+  }
+
+  // Thread safe, a flow parked with shards::park will be resumed on next tick.
+  // Waking a flow that is not parked (or not in this mesh) does nothing.
+  void wake(SHFlow *flow) {
+    {
+      std::scoped_lock lock(_wakeMutex);
+      _woken.emplace_back(flow);
+    }
+    _wakeCv.notify_all();
+  }
+
+  // Thread safe, called by shards::stop. A flow stopped while sleeping or parked
+  // is moved back to the ready queue on next tick, where it gets cleaned up.
+  void stopped(SHWire *wire) {
+    {
+      std::scoped_lock lock(_wakeMutex);
+      _stopped.emplace_back(wire);
+    }
+    _wakeCv.notify_all();
+  }
+
   const std::vector<std::string> &errors() { return _errors; }
 
+  // Opt-in threaded mode, flows get ticked by a pool of `count` worker threads
+  // with per-worker deques and work stealing. Wires sharing mesh variables are
+  // pinned to the same worker, independent wires can be stolen until their first
+  // tick and stay on the worker that started them from then on.
+  // Call before scheduling, 0 (the default) ticks on the calling thread.
+  void setWorkers(uint32_t count);
+
+  uint32_t workers() const;
+
+  // number of flow ticks each worker performed since setWorkers
+  std::vector<uint64_t> workerTicks() const;
+
+  // Instruments every shard activation of wires scheduled from now on, recording
+  // calls, inclusive and exclusive time per shard instance.
+  // Also enabled by the SHARDS_PROFILE=<file> environment variable, in that case
+  // collapsed stacks are appended to <file> when the mesh is destroyed.
+  void setProfiling(bool enabled) { _profiling = enabled; }
+
+  bool profiling() const { return _profiling; }
+
+  // Writes one line per shard, the stack is wire;shard@position;...
+  // collapsed: "<stack> <exclusive ns>", readable by flamegraph.pl, inferno or speedscope
+  // otherwise: "<stack> <calls> <inclusive ns> <exclusive ns>"
+  // Not thread safe, call between ticks.
+  void dumpProfile(std::ostream &out, bool collapsed = true) const;
+
   std::unordered_map<std::string, SHVar, std::hash<std::string>, std::equal_to<std::string>,
                      boost::alignment::aligned_allocator<std::pair<const std::string, SHVar>, 16>>
       variables;
 
   std::unordered_map<std::string, SHVar *> refs;
 
+  // guards variables and refs lookups when warming up wires from workers
+  std::mutex variablesMutex;
+
   std::unordered_map<SHWire *, SHTypeInfo> visitedWires;
 
   std::unordered_set<std::shared_ptr<SHWire>> scheduled;
@@ -587,9 +780,133 @@ struct SHMesh : public std::enable_shared_from_this<SHMesh> {
   SHInstanceData instanceData{};
 
 private:
-  std::list<std::shared_ptr<SHFlow>> _flows;
+  static void collectSharedVariables(const SHComposeResult &result, std::vector<std::string> &out);
+  void pinWire(SHWire *wire, const std::vector<std::string> *sharedVariables);
+  uint32_t pinGroup(uint32_t group);
+  bool tickThreaded(SHVar input);
+  // true if called by a wire ticking on one of our workers
+  bool onWorker() const;
+
+  struct SleepingFlow {
+    SHDuration deadline;
+    std::shared_ptr<SHFlow> flow;
+
+    bool operator>(const SleepingFlow &other) const { return deadline > other.deadline; }
+  };
+
+  // moves woken flows and flows whose deadline passed into the ready queue
+  void wakeUp(SHDuration now) {
+    {
+      std::scoped_lock lock(_wakeMutex);
+      _waking.swap(_woken);
+      _stopping.swap(_stopped);
+    }
+    if (!_stopping.empty())
+      dropStopped();
+
+    for (auto flow : _waking) {
+      auto it = _parked.find(flow);
+      if (it != _parked.end()) {
+        if (it->second->wire && it->second->wire->context)
+          it->second->wire->context->next = SHDuration(0);
+        _ready.emplace_back(std::move(it->second));
+        _parked.erase(it);
+      }
+    }
+    _waking.clear();
+
+    while (!_sleeping.empty() && _sleeping.top().deadline <= now) {
+      _ready.emplace_back(std::move(const_cast<SleepingFlow &>(_sleeping.top()).flow));
+      _sleeping.pop();
+    }
+  }
+
+  // wires stopped from outside of their tick, or by remove and the tick itself (no-op)
+  void dropStopped() {
+    std::unordered_set<SHFlow *> sleeping;
+    for (auto wire : _stopping) {
+      auto it = _flows.find(wire);
+      // the address might be reused by a wire scheduled after the stop
+      if (it == _flows.end() || shards::isRunning(wire))
+        continue;
+
+      auto &flow = it->second;
+      if (_parked.erase(flow.get()) > 0) {
+        _ready.emplace_back(flow);
+      } else {
+        sleeping.insert(flow.get());
+      }
+    }
+    _stopping.clear();
+
+    if (!sleeping.empty())
+      dropSleeping(sleeping, true);
+  }
+
+  // no removal from a priority queue, rebuilds it without flows, resumed right away if resume
+  void dropSleeping(const std::unordered_set<SHFlow *> &flows, bool resume) {
+    std::vector<SleepingFlow> keep;
+    while (!_sleeping.empty()) {
+      auto &top = const_cast<SleepingFlow &>(_sleeping.top());
+      if (flows.count(top.flow.get()) == 0) {
+        keep.emplace_back(std::move(top));
+      } else if (resume) {
+        _ready.emplace_back(std::move(top.flow));
+      }
+      _sleeping.pop();
+    }
+    for (auto &entry : keep) {
+      _sleeping.push(std::move(entry));
+    }
+  }
+
+  // queues a flow that was just ticked and is still running
+  void suspended(const std::shared_ptr<SHFlow> &flow, SHDuration now) {
+    auto deadline = flow->wire->context ? flow->wire->context->next : SHDuration(0);
+    if (deadline == SHDuration::max()) {
+      _parked.emplace(flow.get(), flow);
+    } else if (deadline > now) {
+      _sleeping.push(SleepingFlow{deadline, flow});
+    } else {
+      _ready.emplace_back(flow);
+    }
+  }
+
+  std::unordered_map<SHWire *, std::shared_ptr<SHFlow>> _flows;
+  // flows to resume on next tick, in order
+  std::vector<std::shared_ptr<SHFlow>> _ready;
+  // swapped with _ready during a tick, flows scheduled while ticking end up in _ready
+  std::vector<std::shared_ptr<SHFlow>> _ticking;
+  // flows suspended until a deadline (Pause etc), earliest on top
+  std::priority_queue<SleepingFlow, std::vector<SleepingFlow>, std::greater<SleepingFlow>> _sleeping;
+  // flows waiting for a wake call, see shards::park
+  std::unordered_map<SHFlow *, std::shared_ptr<SHFlow>> _parked;
+  mutable std::mutex _wakeMutex;
+  mutable std::condition_variable _wakeCv;
+  std::vector<SHFlow *> _woken;
+  std::vector<SHFlow *> _waking;
+  std::vector<SHWire *> _stopped;
+  std::vector<SHWire *> _stopping;
   std::vector<std::string> _errors;
-  SHMesh() = default;
+
+  std::unique_ptr<shards::MeshWorkers> _workers;
+  std::recursive_mutex _scheduleMutex;
+  // remove and terminate calls made by workers, applied when the threaded tick ends
+  std::vector<std::shared_ptr<SHWire>> _deferredRemovals;
+  bool _deferredTerminate{false};
+  // union-find of wires sharing variables, see pinWire
+  std::unordered_map<SHWire *, uint32_t> _pinnedGroups;
+  std::unordered_map<std::string, uint32_t> _variableGroups;
+  std::vector<uint32_t> _groupParents;
+  // worker that first ticked an unpinned wire, it resumes there from then on, see MeshWorkers
+  std::unordered_map<SHWire *, uint32_t> _homes;
+
+  bool _profiling{false};
+  std::string _profilePath;
+  // by wire name, kept after wires stop so their numbers still get dumped
+  std::vector<std::pair<std::string, std::shared_ptr<shards::ProfileNode>>> _profiles;
+
+  SHMesh();
 };
 
 namespace shards {
@@ -605,17 +922,201 @@ struct Serialization {
     }
     wires.clear();
     defaultShards.clear();
+    _borrowedSources.clear();
   }
 
   ~Serialization() { reset(); }
 
+  // reads both the compact format and the legacy one (version 1), see serialize
   template <class BinaryReader> void deserialize(BinaryReader &read, SHVar &output) {
-    // we try to recycle memory so pass a empty None as first timer!
+    if constexpr (CanBorrow<BinaryReader>::value) {
+      // views into the source stay valid until reset
+      if (_borrowedSources.empty() || _borrowedSources.back() != read.source)
+        _borrowedSources.push_back(read.source);
+    }
+
+    uint8_t head;
+    read(&head, 1);
+    if (head == FormatMagic) {
+      uint8_t formatVersion;
+      read(&formatVersion, 1);
+      if (formatVersion != 2) {
+        throw shards::SHException(fmt::format("Unsupported serialization format version: {}", formatVersion));
+      }
+      deserializeNext<true>(read, output);
+    } else {
+      deserializeValue<false>(read, output, SHType(head));
+    }
+  }
+
+  // Version 1 writes every field fixed width, version 2 (the default) is prefixed by
+  // FormatMagic and the version, then uses varints for lengths and ints and packs
+  // seqs of same typed blittable values. Writes are buffered and flushed in chunks.
+  template <class BinaryWriter> size_t serialize(const SHVar &input, BinaryWriter &write) {
+    BufferedWriter<BinaryWriter> buffered{write, _writeBuffer};
+    size_t total = 0;
+    if (version >= 2) {
+      const uint8_t header[2] = {FormatMagic, 2};
+      buffered(header, 2);
+      total += 2;
+      total += serializeValue<true>(input, buffered);
+    } else {
+      total += serializeValue<false>(input, buffered);
+    }
+    buffered.flush();
+    return total;
+  }
+
+  static constexpr uint8_t LatestVersion = 2;
+  // format written by serialize, set to 1 for peers that only read the legacy format
+  uint8_t version{LatestVersion};
+
+private:
+  // never a valid SHType, marks the versioned formats
+  static constexpr uint8_t FormatMagic = 0xFF;
+  static constexpr size_t WriteBufferSize = 64 * 1024;
+
+  template <class BinaryWriter> struct BufferedWriter {
+    BinaryWriter &inner;
+    std::vector<uint8_t> &buffer;
+
+    // reserve only, no zero fill, and a no-op once the instance serialized before
+    BufferedWriter(BinaryWriter &inner, std::vector<uint8_t> &buffer) : inner(inner), buffer(buffer) {
+      buffer.clear();
+      buffer.reserve(WriteBufferSize);
+    }
+
+    void operator()(const uint8_t *buf, size_t size) {
+      if (buffer.size() + size > WriteBufferSize) {
+        flush();
+        if (size >= WriteBufferSize) {
+          inner(buf, size);
+          return;
+        }
+      }
+      buffer.insert(buffer.end(), buf, buf + size);
+    }
+
+    void flush() {
+      if (!buffer.empty()) {
+        inner(buffer.data(), buffer.size());
+        buffer.clear();
+      }
+    }
+  };
+
+  template <bool V2, typename T, class BinaryReader> static T readLength(BinaryReader &read) {
+    if constexpr (V2) {
+      uint64_t value = 0;
+      for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+        read(&byte, 1);
+        value |= uint64_t(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+          return T(value);
+      }
+      throw shards::SHException("Invalid varint while deserializing");
+    } else {
+      T value;
+      read((uint8_t *)&value, sizeof(T));
+      return value;
+    }
+  }
+
+  template <bool V2, typename T, class BinaryWriter> static size_t writeLength(BinaryWriter &write, T value) {
+    if constexpr (V2) {
+      uint8_t buf[10];
+      size_t len = 0;
+      auto v = uint64_t(value);
+      while (v >= 0x80) {
+        buf[len++] = uint8_t(v) | 0x80;
+        v >>= 7;
+      }
+      buf[len++] = uint8_t(v);
+      write(buf, len);
+      return len;
+    } else {
+      write((const uint8_t *)&value, sizeof(T));
+      return sizeof(T);
+    }
+  }
+
+  // readers providing borrow(size, alignment) lend their memory, see BorrowingReader
+  template <class BinaryReader, class = void> struct CanBorrow : std::false_type {};
+  template <class BinaryReader>
+  struct CanBorrow<BinaryReader, std::void_t<decltype(std::declval<BinaryReader &>().borrow(size_t(0), size_t(1)))>>
+      : std::true_type {};
+
+  // smaller payloads are still copied, their memory is recycled across deserializations anyway
+  static constexpr size_t BorrowThreshold = 4096;
+
+  template <class BinaryReader> static const uint8_t *borrow(BinaryReader &read, size_t size, size_t alignment) {
+    if (size < BorrowThreshold)
+      return nullptr;
+    return read.borrow(size, alignment);
+  }
+
+  // zigzag varint, small negative values stay small too
+  template <class BinaryReader> static int64_t readInt(BinaryReader &read) {
+    auto zz = readLength<true, uint64_t>(read);
+    return int64_t(zz >> 1) ^ -int64_t(zz & 1);
+  }
+
+  template <class BinaryWriter> static size_t writeInt(BinaryWriter &write, int64_t value) {
+    return writeLength<true>(write, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+  }
+
+  // payload size of values that can be packed in version 2 seqs, 0 if not packable
+  static size_t packedSize(SHType type) {
+    switch (type) {
+    case SHType::Enum:
+      return sizeof(int32_t) * 3;
+    case SHType::Bool:
+      return sizeof(SHBool);
+    case SHType::Int:
+      return sizeof(SHInt);
+    case SHType::Int2:
+      return sizeof(SHInt2);
+    case SHType::Int3:
+      return sizeof(SHInt3);
+    case SHType::Int4:
+      return sizeof(SHInt4);
+    case SHType::Int8:
+      return sizeof(SHInt8);
+    case SHType::Int16:
+      return sizeof(SHInt16);
+    case SHType::Float:
+      return sizeof(SHFloat);
+    case SHType::Float2:
+      return sizeof(SHFloat2);
+    case SHType::Float3:
+      return sizeof(SHFloat3);
+    case SHType::Float4:
+      return sizeof(SHFloat4);
+    case SHType::Color:
+      return sizeof(SHColor);
+    default:
+      return 0;
+    }
+  }
+
+  template <bool V2, class BinaryReader> void deserializeNext(BinaryReader &read, SHVar &output) {
     SHType nextType;
     read((uint8_t *)&nextType, sizeof(output.valueType));
+    deserializeValue<V2>(read, output, nextType);
+  }
+
+  template <bool V2, class BinaryReader> void deserializeValue(BinaryReader &read, SHVar &output, SHType nextType) {
+    // we try to recycle memory so pass a empty None as first timer!
+
+    // views don't own their memory, forget them rather than free or recycle
+    auto recycle = (output.flags & SHVAR_FLAGS_BORROWED) == 0;
+    if (!recycle) {
+      output.flags &= ~SHVAR_FLAGS_BORROWED;
+      memset(&output.payload, 0x0, sizeof(SHVarPayload));
+    }
 
     // stop trying to recycle, types differ
-    auto recycle = true;
     if (output.valueType != nextType) {
       varFree(output);
       recycle = false;
@@ -635,7 +1136,11 @@ struct Serialization {
       read((uint8_t *)&output.payload, sizeof(SHBool));
       break;
     case SHType::Int:
-      read((uint8_t *)&output.payload, sizeof(SHInt));
+      if constexpr (V2) {
+        output.payload.intValue = readInt(read);
+      } else {
+        read((uint8_t *)&output.payload, sizeof(SHInt));
+      }
       break;
     case SHType::Int2:
       read((uint8_t *)&output.payload, sizeof(SHInt2));
@@ -669,7 +1174,18 @@ struct Serialization {
       break;
     case SHType::Bytes: {
       auto availBytes = recycle ? output.payload.bytesCapacity : 0;
-      read((uint8_t *)&output.payload.bytesSize, sizeof(output.payload.bytesSize));
+      output.payload.bytesSize = readLength<V2, uint32_t>(read);
+
+      if constexpr (CanBorrow<BinaryReader>::value) {
+        if (auto view = borrow(read, output.payload.bytesSize, 1)) {
+          if (availBytes > 0)
+            delete[] output.payload.bytesValue;
+          output.payload.bytesValue = const_cast<uint8_t *>(view);
+          output.payload.bytesCapacity = 0;
+          output.flags |= SHVAR_FLAGS_BORROWED;
+          break;
+        }
+      }
 
       if (availBytes > 0 && availBytes < output.payload.bytesSize) {
         // not enough space, ideally realloc, but for now just delete
@@ -689,8 +1205,7 @@ struct Serialization {
     }
     case SHType::Array: {
       read((uint8_t *)&output.innerType, sizeof(output.innerType));
-      uint32_t len;
-      read((uint8_t *)&len, sizeof(uint32_t));
+      auto len = readLength<V2, uint32_t>(read);
       shards::arrayResize(output.payload.arrayValue, len);
       read((uint8_t *)&output.payload.arrayValue.elements[0], len * sizeof(SHVarPayload));
       break;
@@ -699,34 +1214,52 @@ struct Serialization {
     case SHType::String:
     case SHType::ContextVar: {
       auto availChars = recycle ? output.payload.stringCapacity : 0;
-      uint32_t len;
-      read((uint8_t *)&len, sizeof(uint32_t));
+      auto len = readLength<V2, uint32_t>(read);
 
       if (availChars > 0 && availChars < len) {
         // we need more chars then what we have, realloc
-        delete[] output.payload.stringValue;
-        output.payload.stringValue = new char[len + 1];
+        freeString(output.payload.stringValue, availChars);
+        output.payload.stringValue = allocString(len, output.payload.stringCapacity);
       } else if (availChars == 0) {
         // just alloc
-        output.payload.stringValue = new char[len + 1];
+        output.payload.stringValue = allocString(len, output.payload.stringCapacity);
       } // else recycling
 
-      // record actualSize
-      output.payload.stringCapacity = std::max(availChars, len);
-
       read((uint8_t *)output.payload.stringValue, len);
       const_cast<char *>(output.payload.stringValue)[len] = 0;
       output.payload.stringLen = len;
       break;
     }
     case SHType::Seq: {
-      uint32_t len;
-      read((uint8_t *)&len, sizeof(uint32_t));
+      auto len = readLength<V2, uint32_t>(read);
       // notice we assume all elements up to capacity are memset to 0x0
       // or are valid SHVars we can overwrite
       shards::arrayResize(output.payload.seqValue, len);
+      if constexpr (V2) {
+        SHType packed;
+        read((uint8_t *)&packed, sizeof(packed));
+        if (packed != SHType::EndOfBlittableTypes) {
+          const auto size = packedSize(packed);
+          if (size == 0) {
+            throw shards::SHException("Invalid packed seq type while deserializing");
+          }
+          for (uint32_t i = 0; i < len; i++) {
+            auto &element = output.payload.seqValue.elements[i];
+            if (element.valueType != packed) {
+              varFree(element);
+              element.valueType = packed;
+            }
+            if (packed == SHType::Int) {
+              element.payload.intValue = readInt(read);
+            } else {
+              read((uint8_t *)&element.payload, size);
+            }
+          }
+          break;
+        }
+      }
       for (uint32_t i = 0; i < len; i++) {
-        deserialize(read, output.payload.seqValue.elements[i]);
+        deserializeNext<V2>(read, output.payload.seqValue.elements[i]);
       }
       break;
     }
@@ -749,17 +1282,15 @@ struct Serialization {
         output.payload.tableValue.opaque = map;
       }
 
-      uint64_t len;
+      auto len = readLength<V2, uint64_t>(read);
       std::string keyBuf;
-      read((uint8_t *)&len, sizeof(uint64_t));
       for (uint64_t i = 0; i < len; i++) {
-        uint32_t klen;
-        read((uint8_t *)&klen, sizeof(uint32_t));
+        auto klen = readLength<V2, uint32_t>(read);
         keyBuf.resize(klen);
         read((uint8_t *)keyBuf.c_str(), klen);
         // TODO improve this, avoid allocations
         SHVar tmp{};
-        deserialize(read, tmp);
+        deserializeNext<V2>(read, tmp);
         auto &dst = (*map)[keyBuf];
         dst = tmp;
         varFree(tmp);
@@ -785,12 +1316,11 @@ struct Serialization {
         output.payload.setValue.opaque = set;
       }
 
-      uint64_t len;
-      read((uint8_t *)&len, sizeof(uint64_t));
+      auto len = readLength<V2, uint64_t>(read);
       for (uint64_t i = 0; i < len; i++) {
         // TODO improve this, avoid allocations
         SHVar dst{};
-        deserialize(read, dst);
+        deserializeNext<V2>(read, dst);
         (*set).emplace(dst);
         varFree(dst);
       }
@@ -822,6 +1352,16 @@ struct Serialization {
       size_t size =
           output.payload.imageValue.channels * output.payload.imageValue.height * output.payload.imageValue.width * pixsize;
 
+      if constexpr (CanBorrow<BinaryReader>::value) {
+        if (auto view = borrow(read, size, pixsize)) {
+          if (currentSize > 0)
+            delete[] output.payload.imageValue.data;
+          output.payload.imageValue.data = const_cast<uint8_t *>(view);
+          output.flags |= SHVAR_FLAGS_BORROWED;
+          break;
+        }
+      }
+
       if (currentSize > 0 && currentSize < size) {
         // delete first & alloc
         delete[] output.payload.imageValue.data;
@@ -846,6 +1386,16 @@ struct Serialization {
 
       size_t size = output.payload.audioValue.nsamples * output.payload.audioValue.channels * sizeof(float);
 
+      if constexpr (CanBorrow<BinaryReader>::value) {
+        if (auto view = borrow(read, size, alignof(float))) {
+          if (currentSize > 0)
+            delete[] output.payload.audioValue.samples;
+          output.payload.audioValue.samples = reinterpret_cast<float *>(const_cast<uint8_t *>(view));
+          output.flags |= SHVAR_FLAGS_BORROWED;
+          break;
+        }
+      }
+
       if (currentSize > 0 && currentSize < size) {
         // delete first & alloc
         delete[] output.payload.audioValue.samples;
@@ -860,8 +1410,7 @@ struct Serialization {
     }
     case SHType::ShardRef: {
       Shard *blk;
-      uint32_t len;
-      read((uint8_t *)&len, sizeof(uint32_t));
+      auto len = readLength<V2, uint32_t>(read);
       std::vector<char> buf;
       buf.resize(len + 1);
       read((uint8_t *)&buf[0], len);
@@ -882,17 +1431,22 @@ struct Serialization {
       auto params = blk->parameters(blk).len + 1;
       while (params--) {
         int idx;
-        read((uint8_t *)&idx, sizeof(int));
+        if constexpr (V2) {
+          // shifted by one, 0 terminates
+          idx = int(readLength<V2, uint32_t>(read)) - 1;
+        } else {
+          read((uint8_t *)&idx, sizeof(int));
+        }
         if (idx == -1)
           break;
         SHVar tmp{};
-        deserialize(read, tmp);
+        deserializeNext<V2>(read, tmp);
         blk->setParam(blk, idx, &tmp);
         varFree(tmp);
       }
       if (blk->setState) {
         SHVar state{};
-        deserialize(read, state);
+        deserializeNext<V2>(read, state);
         blk->setState(blk, &state);
         varFree(state);
       }
@@ -900,8 +1454,7 @@ struct Serialization {
       break;
     }
     case SHType::Wire: {
-      uint32_t len;
-      read((uint8_t *)&len, sizeof(uint32_t));
+      auto len = readLength<V2, uint32_t>(read);
       std::vector<char> buf;
       buf.resize(len + 1);
       read((uint8_t *)&buf[0], len);
@@ -922,11 +1475,11 @@ struct Serialization {
       read((uint8_t *)&wire->looped, 1);
       read((uint8_t *)&wire->unsafe, 1);
       // shards len
-      read((uint8_t *)&len, sizeof(uint32_t));
+      len = readLength<V2, uint32_t>(read);
       // shards
       for (uint32_t i = 0; i < len; i++) {
         SHVar shardVar{};
-        deserialize(read, shardVar);
+        deserializeNext<V2>(read, shardVar);
         assert(shardVar.valueType == ShardRef);
         wire->addShard(shardVar.payload.shardValue);
         // blow's owner is the wire
@@ -936,8 +1489,7 @@ struct Serialization {
     case SHType::Object: {
       int64_t id;
       read((uint8_t *)&id, sizeof(int64_t));
-      uint64_t len;
-      read((uint8_t *)&len, sizeof(uint64_t));
+      auto len = readLength<V2, uint64_t>(read);
       if (len > 0) {
         auto it = GetGlobals().ObjectTypesRegister.find(id);
         if (it != GetGlobals().ObjectTypesRegister.end()) {
@@ -966,7 +1518,7 @@ struct Serialization {
     }
   }
 
-  template <class BinaryWriter> size_t serialize(const SHVar &input, BinaryWriter &write) {
+  template <bool V2, class BinaryWriter> size_t serializeValue(const SHVar &input, BinaryWriter &write) {
     size_t total = 0;
     write((const uint8_t *)&input.valueType, sizeof(input.valueType));
     total += sizeof(input.valueType);
@@ -984,8 +1536,12 @@ struct Serialization {
       total += sizeof(SHBool);
       break;
     case SHType::Int:
-      write((const uint8_t *)&input.payload, sizeof(SHInt));
-      total += sizeof(SHInt);
+      if constexpr (V2) {
+        total += writeInt(write, input.payload.intValue);
+      } else {
+        write((const uint8_t *)&input.payload, sizeof(SHInt));
+        total += sizeof(SHInt);
+      }
       break;
     case SHType::Int2:
       write((const uint8_t *)&input.payload, sizeof(SHInt2));
@@ -1028,16 +1584,14 @@ struct Serialization {
       total += sizeof(SHColor);
       break;
     case SHType::Bytes:
-      write((const uint8_t *)&input.payload.bytesSize, sizeof(input.payload.bytesSize));
-      total += sizeof(input.payload.bytesSize);
+      total += writeLength<V2>(write, input.payload.bytesSize);
       write((const uint8_t *)input.payload.bytesValue, input.payload.bytesSize);
       total += input.payload.bytesSize;
       break;
     case SHType::Array: {
       write((const uint8_t *)&input.innerType, sizeof(input.innerType));
       total += sizeof(input.innerType);
-      write((const uint8_t *)&input.payload.arrayValue.len, sizeof(uint32_t));
-      total += sizeof(uint32_t);
+      total += writeLength<V2>(write, uint32_t(input.payload.arrayValue.len));
       auto size = input.payload.arrayValue.len * sizeof(SHVarPayload);
       write((const uint8_t *)&input.payload.arrayValue.elements[0], size);
       total += size;
@@ -1048,18 +1602,42 @@ struct Serialization {
       uint32_t len = input.payload.stringLen > 0 || input.payload.stringValue == nullptr
                          ? input.payload.stringLen
                          : uint32_t(strlen(input.payload.stringValue));
-      write((const uint8_t *)&len, sizeof(uint32_t));
-      total += sizeof(uint32_t);
+      total += writeLength<V2>(write, len);
       write((const uint8_t *)input.payload.stringValue, len);
       total += len;
       break;
     }
     case SHType::Seq: {
       uint32_t len = input.payload.seqValue.len;
-      write((const uint8_t *)&len, sizeof(uint32_t));
-      total += sizeof(uint32_t);
+      total += writeLength<V2>(write, len);
+      if constexpr (V2) {
+        // same typed blittable values are written back to back without type tags
+        auto packed = len > 0 ? input.payload.seqValue.elements[0].valueType : SHType::EndOfBlittableTypes;
+        const auto size = packedSize(packed);
+        for (uint32_t i = 1; size != 0 && i < len; i++) {
+          if (input.payload.seqValue.elements[i].valueType != packed)
+            packed = SHType::EndOfBlittableTypes;
+        }
+        if (size == 0)
+          packed = SHType::EndOfBlittableTypes;
+        write((const uint8_t *)&packed, sizeof(packed));
+        total += sizeof(packed);
+        if (packed != SHType::EndOfBlittableTypes) {
+          if (packed == SHType::Int) {
+            for (uint32_t i = 0; i < len; i++) {
+              total += writeInt(write, input.payload.seqValue.elements[i].payload.intValue);
+            }
+          } else {
+            for (uint32_t i = 0; i < len; i++) {
+              write((const uint8_t *)&input.payload.seqValue.elements[i].payload, size);
+            }
+            total += size * len;
+          }
+          break;
+        }
+      }
       for (uint32_t i = 0; i < len; i++) {
-        total += serialize(input.payload.seqValue.elements[i], write);
+        total += serializeValue<V2>(input.payload.seqValue.elements[i], write);
       }
       break;
     }
@@ -1067,24 +1645,21 @@ struct Serialization {
       if (input.payload.tableValue.api && input.payload.tableValue.opaque) {
         auto &t = input.payload.tableValue;
         uint64_t len = (uint64_t)t.api->tableSize(t);
-        write((const uint8_t *)&len, sizeof(uint64_t));
-        total += sizeof(uint64_t);
+        total += writeLength<V2>(write, len);
         SHTableIterator tit;
         t.api->tableGetIterator(t, &tit);
         SHString k;
         SHVar v;
         while (t.api->tableNext(t, &tit, &k, &v)) {
           uint32_t klen = strlen(k);
-          write((const uint8_t *)&klen, sizeof(uint32_t));
-          total += sizeof(uint32_t);
+          total += writeLength<V2>(write, klen);
           write((const uint8_t *)k, klen);
           total += klen;
-          total += serialize(v, write);
+          total += serializeValue<V2>(v, write);
         }
       } else {
         uint64_t none = 0;
-        write((const uint8_t *)&none, sizeof(uint64_t));
-        total += sizeof(uint64_t);
+        total += writeLength<V2>(write, none);
       }
       break;
     }
@@ -1092,18 +1667,16 @@ struct Serialization {
       if (input.payload.setValue.api && input.payload.setValue.opaque) {
         auto &s = input.payload.setValue;
         uint64_t len = (uint64_t)s.api->setSize(s);
-        write((const uint8_t *)&len, sizeof(uint64_t));
-        total += sizeof(uint64_t);
+        total += writeLength<V2>(write, len);
         SHSetIterator sit;
         s.api->setGetIterator(s, &sit);
         SHVar v;
         while (s.api->setNext(s, &sit, &v)) {
-          total += serialize(v, write);
+          total += serializeValue<V2>(v, write);
         }
       } else {
         uint64_t none = 0;
-        write((const uint8_t *)&none, sizeof(uint64_t));
-        total += sizeof(uint64_t);
+        total += writeLength<V2>(write, none);
       }
       break;
     }
@@ -1147,8 +1720,7 @@ struct Serialization {
       // name
       auto name = blk->name(blk);
       uint32_t len = uint32_t(strlen(name));
-      write((const uint8_t *)&len, sizeof(uint32_t));
-      total += sizeof(uint32_t);
+      total += writeLength<V2>(write, len);
       write((const uint8_t *)name, len);
       total += len;
       // serialize the hash of the shard as well
@@ -1170,17 +1742,26 @@ struct Serialization {
         auto dval = model->getParam(model, idx);
         auto pval = blk->getParam(blk, idx);
         if (pval != dval) {
-          write((const uint8_t *)&idx, sizeof(int));
-          total += serialize(pval, write) + sizeof(int);
+          if constexpr (V2) {
+            total += writeLength<V2>(write, uint32_t(idx + 1));
+          } else {
+            write((const uint8_t *)&idx, sizeof(int));
+            total += sizeof(int);
+          }
+          total += serializeValue<V2>(pval, write);
         }
       }
-      int idx = -1; // end of params
-      write((const uint8_t *)&idx, sizeof(int));
-      total += sizeof(int);
+      if constexpr (V2) {
+        total += writeLength<V2>(write, uint32_t(0)); // end of params
+      } else {
+        int idx = -1; // end of params
+        write((const uint8_t *)&idx, sizeof(int));
+        total += sizeof(int);
+      }
       // optional state
       if (blk->getState) {
         auto state = blk->getState(blk);
-        total += serialize(state, write);
+        total += serializeValue<V2>(state, write);
       }
       break;
     }
@@ -1190,8 +1771,7 @@ struct Serialization {
 
       { // Name
         uint32_t len = uint32_t(wire->name.size());
-        write((const uint8_t *)&len, sizeof(uint32_t));
-        total += sizeof(uint32_t);
+        total += writeLength<V2>(write, len);
         write((const uint8_t *)wire->name.c_str(), len);
         total += len;
       }
@@ -1213,15 +1793,14 @@ struct Serialization {
       }
       { // Shards len
         uint32_t len = uint32_t(wire->shards.size());
-        write((const uint8_t *)&len, sizeof(uint32_t));
-        total += sizeof(uint32_t);
+        total += writeLength<V2>(write, len);
       }
       // Shards
       for (auto shard : wire->shards) {
         SHVar shardVar{};
         shardVar.valueType = SHType::ShardRef;
         shardVar.payload.shardValue = shard;
-        total += serialize(shardVar, write);
+        total += serializeValue<V2>(shardVar, write);
       }
       break;
     }
@@ -1238,33 +1817,96 @@ struct Serialization {
           throw shards::SHException("Failed to serialize custom object variable!");
         }
         uint64_t ulen = uint64_t(len);
-        write((const uint8_t *)&ulen, sizeof(uint64_t));
-        total += sizeof(uint64_t);
+        total += writeLength<V2>(write, ulen);
         write((const uint8_t *)&data[0], len);
         total += len;
         input.objectInfo->free(handle);
       } else {
         uint64_t empty = 0;
-        write((const uint8_t *)&empty, sizeof(uint64_t));
-        total += sizeof(uint64_t);
+        total += writeLength<V2>(write, empty);
       }
       break;
     }
     }
     return total;
   }
+
+  std::vector<uint8_t> _writeBuffer;
+  std::vector<std::shared_ptr<const void>> _borrowedSources;
 };
 
-template <typename T> struct WireDoppelgangerPool {
-  WireDoppelgangerPool(SHWireRef master) {
-    auto vwire = shards::Var(master);
-    std::stringstream stream;
-    Writer w(stream);
-    Serialization serializer;
-    serializer.serialize(vwire, w);
-    _wireStr = stream.str();
+// Reads from a buffer kept alive by `source`. Serialization deserializes large
+// Bytes, Image and Audio payloads as views into it rather than copies, such
+// variables are flagged SHVAR_FLAGS_BORROWED and stay valid until the
+// Serialization is reset or destroyed.
+struct BorrowingReader {
+  std::shared_ptr<const void> source;
+  const uint8_t *data;
+  size_t size;
+  size_t offset{0};
+
+  BorrowingReader(std::shared_ptr<const void> source, const uint8_t *data, size_t size)
+      : source(std::move(source)), data(data), size(size) {}
+
+  void operator()(uint8_t *buf, size_t len) {
+    if (size - offset < len) {
+      throw ActivationError("BorrowingReader buffer underrun");
+    }
+    memcpy(buf, data + offset, len);
+    offset += len;
   }
 
+  // nullptr if the data at the current offset is not aligned, the caller should copy then
+  const uint8_t *borrow(size_t len, size_t alignment) {
+    if (size - offset < len) {
+      throw ActivationError("BorrowingReader buffer underrun");
+    }
+    auto view = data + offset;
+    if (reinterpret_cast<uintptr_t>(view) % alignment != 0)
+      return nullptr;
+    offset += len;
+    return view;
+  }
+};
+
+// Deep copies wires without a Serialization round-trip, shards are created by name
+// and get copies of their non default parameters and state.
+// Nested shards and wires found in parameters are cloned as well, each nested wire once per clone.
+// Throws if a parameter holds shards or wires inside a table or set, or an object,
+// those only Serialization knows how to copy.
+struct WireCloner {
+  std::shared_ptr<SHWire> clone(const SHWire *wire) {
+    _wires.clear();
+    DEFER(_wires.clear());
+    return cloneWire(wire);
+  }
+
+private:
+  std::shared_ptr<SHWire> cloneWire(const SHWire *wire);
+  Shard *cloneShard(Shard *shard);
+  void cloneValue(SHVar &dst, const SHVar &src);
+  static void freeValue(SHVar &var);
+  static bool hasReferences(const SHVar &var);
+
+  std::unordered_map<const SHWire *, std::shared_ptr<SHWire>> _wires;
+  // to skip parameters left to their default value
+  std::unordered_map<std::string, std::shared_ptr<Shard>> _defaultShards;
+};
+
+template <typename T> struct WireDoppelgangerPool {
+  WireDoppelgangerPool(SHWireRef master) : _master(SHWire::sharedFromRef(master)) {}
+
+  struct Stats {
+    uint64_t hits;
+    uint64_t misses;
+    // misses that had to go through serialization
+    uint64_t serialized;
+    size_t size;
+    size_t available;
+  };
+
+  Stats stats() const { return Stats{_hits, _misses, _serialized, _pool.size(), _avail.size()}; }
+
   // notice users should stop wires themselves, we might want wires to persist
   // after this object lifetime
   void stopAll() {
@@ -1276,26 +1918,65 @@ template <typename T> struct WireDoppelgangerPool {
 
   template <class Composer> std::shared_ptr<T> acquire(Composer &composer) {
     if (_avail.size() == 0) {
-      Serialization serializer;
-      std::stringstream stream(_wireStr);
-      Reader r(stream);
-      SHVar vwire{};
-      serializer.deserialize(r, vwire);
-      auto wire = SHWire::sharedFromRef(vwire.payload.wireValue);
-      auto fresh = _pool.emplace_back(std::make_shared<T>());
-      fresh->wire = wire;
-      composer.compose(wire.get());
-      fresh->wire->name = fresh->wire->name + "-" + std::to_string(_pool.size());
-      return fresh;
+      _misses++;
+      return make(composer);
     } else {
+      _hits++;
       auto res = _avail.extract(_avail.begin());
       return res.value();
     }
   }
 
+  // creates instances ahead of demand until `count` are available
+  template <class Composer> void prewarm(size_t count, Composer &composer) {
+    while (_avail.size() < count) {
+      _avail.emplace(make(composer));
+    }
+  }
+
   void release(std::shared_ptr<T> wire) { _avail.emplace(wire); }
 
 private:
+  template <class Composer> std::shared_ptr<T> make(Composer &composer) {
+    auto master = _master.lock();
+    if (!master) {
+      throw SHException("WireDoppelgangerPool: master wire expired");
+    }
+
+    std::shared_ptr<SHWire> wire;
+    if (_wireStr.empty()) {
+      try {
+        wire = _cloner.clone(master.get());
+      } catch (const SHException &e) {
+        SHLOG_DEBUG("Wire {} can't be cloned directly, using serialization: {}", master->name, e.what());
+        auto vwire = shards::Var(SHWire::weakRef(master));
+        std::stringstream stream;
+        Writer w(stream);
+        Serialization serializer;
+        serializer.serialize(vwire, w);
+        _wireStr = stream.str();
+      }
+    }
+
+    if (!wire) {
+      _serialized++;
+      Serialization serializer;
+      std::stringstream stream(_wireStr);
+      Reader r(stream);
+      SHVar vwire{};
+      serializer.deserialize(r, vwire);
+      wire = SHWire::sharedFromRef(vwire.payload.wireValue);
+      // wire holds its own reference
+      SHWire::deleteRef(vwire.payload.wireValue);
+    }
+
+    auto fresh = _pool.emplace_back(std::make_shared<T>());
+    fresh->wire = wire;
+    composer.compose(wire.get());
+    fresh->wire->name = fresh->wire->name + "-" + std::to_string(_pool.size());
+    return fresh;
+  }
+
   struct Writer {
     std::stringstream &stream;
     Writer(std::stringstream &stream) : stream(stream) {}
@@ -1313,7 +1994,14 @@ private:
   // just release when possible
   std::deque<std::shared_ptr<T>> _pool;
   std::unordered_set<std::shared_ptr<T>> _avail;
+  // not owning, users of the pool keep the master alive
+  std::weak_ptr<SHWire> _master;
+  WireCloner _cloner;
+  // only used if the master can't be cloned directly
   std::string _wireStr;
+  uint64_t _hits{0};
+  uint64_t _misses{0};
+  uint64_t _serialized{0};
 };
 
 #ifdef __EMSCRIPTEN__
@@ -5,21 +5,69 @@
 #include <atomic>
 #include <boost/lockfree/queue.hpp>
 #include <boost/lockfree/stack.hpp>
+#include <deque>
 #include <mutex>
+#include <shared_mutex>
 #include <variant>
 
 namespace shards {
 namespace channels {
 
+// Flows parked on a channel, waiting for data or room.
+// Waiters publish _count then check the queue again, notifiers change the queue then check
+// _count. Both sides need a full fence in between, or each could miss the other's store.
+struct Waiters {
+  void add(SHContext *context) {
+    {
+      std::scoped_lock<std::mutex> lock(_mutex);
+      _flows.emplace_back(context->main->mesh, context->flow);
+      _count.store(_flows.size(), std::memory_order_relaxed);
+    }
+    // callers check the queue again after this
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  void notify() {
+    // pairs with the fence in add, the queue change must be visible before we read _count
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // cheap check, producers call this every push
+    if (_count.load(std::memory_order_relaxed) == 0)
+      return;
+
+    std::vector<std::pair<std::weak_ptr<SHMesh>, SHFlow *>> flows;
+    {
+      std::scoped_lock<std::mutex> lock(_mutex);
+      flows.swap(_flows);
+      _count.store(0, std::memory_order_relaxed);
+    }
+    for (auto &[weakMesh, flow] : flows) {
+      if (auto mesh = weakMesh.lock())
+        mesh->wake(flow);
+    }
+  }
+
+private:
+  std::mutex _mutex;
+  std::vector<std::pair<std::weak_ptr<SHMesh>, SHFlow *>> _flows;
+  std::atomic_size_t _count{0};
+};
+
 struct ChannelShared {
   SHTypeInfo type;
   std::atomic_bool closed;
+
+  // statistics, see Channel.Stats
+  std::atomic_uint64_t enqueued{0};
+  std::atomic_uint64_t dequeued{0};
+  std::atomic_uint64_t drops{0}; // values a listener never got
 };
 
 struct DummyChannel : public ChannelShared {};
 
 struct MPMCChannel : public ChannelShared {
-  MPMCChannel(bool noCopy) : ChannelShared(), _noCopy(noCopy) {}
+  // capacity 0 means unbounded
+  MPMCChannel(bool noCopy, size_t capacity = 0)
+      : ChannelShared(), data(capacity > 0 ? capacity : 16), capacity(capacity), _noCopy(noCopy) {}
 
   // no real cleanups happens in Produce/Consume to keep things simple
   // and without locks
@@ -35,43 +83,246 @@ struct MPMCChannel : public ChannelShared {
     }
   }
 
+  // false if bounded and full
+  bool push(const SHVar &value) {
+    if (capacity > 0 ? data.bounded_push(value) : data.push(value)) {
+      enqueued.fetch_add(1, std::memory_order_relaxed);
+      consumers.notify();
+      return true;
+    }
+    return false;
+  }
+
+  // pops up to max values in one go, returns how many were added to out
+  size_t pop(std::vector<SHVar> &out, size_t max) {
+    size_t count = 0;
+    SHVar tmp{};
+    while (count < max && data.pop(tmp)) {
+      out.push_back(tmp);
+      count++;
+    }
+    if (count > 0) {
+      dequeued.fetch_add(count, std::memory_order_relaxed);
+      if (capacity > 0)
+        producers.notify();
+    }
+    return count;
+  }
+
+  // approximate, a value is counted as enqueued only after it was pushed so consumers
+  // can count it as dequeued first, read dequeued first and clamp
+  size_t depth() const {
+    const auto out = dequeued.load(std::memory_order_acquire);
+    const auto in = enqueued.load(std::memory_order_acquire);
+    return in > out ? size_t(in - out) : 0;
+  }
+
   // A single source to steal data from
-  boost::lockfree::queue<SHVar> data{16};
+  // when bounded the node pool is preallocated and never grows
+  boost::lockfree::queue<SHVar> data;
   boost::lockfree::stack<SHVar> recycle{16};
+  const size_t capacity;
+
+  Waiters consumers;
+  Waiters producers;
 
 private:
   bool _noCopy;
 };
 
-struct Broadcast;
+// What happens when a listener is Capacity messages behind on a bounded broadcast
+enum class SlowListener {
+  Block,      // broadcasters wait until the listener catches up
+  DropOldest, // the listener skips its oldest unread messages
+  Disconnect  // the listener is disconnected and fails on its next activation
+};
+
+// Broadcast values are stored once and shared by all listeners
+struct BroadcastMessage {
+  SHVar value{};
+  std::atomic_int refcount{0};
+};
+
+// A single ring of refcounted messages, every listener has its own read cursor.
+// Listeners output read-only views of the messages, valid until their next activation.
 class BroadcastChannel : public ChannelShared {
 public:
-  BroadcastChannel(bool noCopy) : ChannelShared(), _noCopy(noCopy) {}
+  struct Subscriber {
+    uint64_t cursor; // sequence of the next message to read
+    std::atomic_bool disconnected{false};
+    std::atomic_bool closed{false};
+  };
+
+  BroadcastChannel(bool noCopy, size_t capacity = 0, SlowListener policy = SlowListener::Block)
+      : ChannelShared(), capacity(capacity), policy(policy), _noCopy(noCopy) {}
+
+  ~BroadcastChannel() {
+    for (auto msg : _ring) {
+      release(msg);
+    }
+    BroadcastMessage *msg;
+    while (_recycle.pop(msg)) {
+      if (!_noCopy)
+        destroyVar(msg->value);
+      delete msg;
+    }
+  }
+
+  std::shared_ptr<Subscriber> subscribe() {
+    std::scoped_lock<std::mutex> lock(_mutex);
+    auto sub = std::make_shared<Subscriber>();
+    // no history, listeners only get what's broadcasted after they subscribed
+    sub->cursor = _head;
+    return _subscribers.emplace_back(sub);
+  }
+
+  // a message to fill and publish, reusing memory when possible
+  BroadcastMessage *acquire() {
+    BroadcastMessage *msg = nullptr;
+    if (!_recycle.pop(msg))
+      msg = new BroadcastMessage();
+    return msg;
+  }
 
-  MPMCChannel &subscribe() {
-    // we automatically cleanup based on the closed flag of the inner channel
-    std::scoped_lock<std::mutex> lock(submutex);
-    return subscribers.emplace_back(_noCopy);
+  void release(BroadcastMessage *msg) {
+    if (msg->refcount.fetch_sub(1) == 1)
+      _recycle.push(msg);
   }
 
-protected:
-  friend struct Broadcast;
-  std::mutex submutex;
-  std::list<MPMCChannel> subscribers;
+  // gives back a message that was never published
+  void discard(BroadcastMessage *msg) { _recycle.push(msg); }
+
+  // false if a listener is full and the policy is Block, nothing is published then
+  bool publish(BroadcastMessage *msg) {
+    {
+      std::scoped_lock<std::mutex> lock(_mutex);
+      if (capacity > 0) {
+        for (auto &sub : _subscribers) {
+          if (sub->closed || sub->disconnected || _head - sub->cursor < capacity)
+            continue;
+
+          switch (policy) {
+          case SlowListener::Block:
+            return false;
+          case SlowListener::DropOldest: {
+            auto next = _head - capacity + 1;
+            drops += next - sub->cursor;
+            sub->cursor = next;
+          } break;
+          case SlowListener::Disconnect:
+            drops += _head - sub->cursor;
+            sub->disconnected = true;
+            break;
+          }
+        }
+      }
+
+      // owned by the ring until every listener read it
+      msg->refcount = 1;
+      _ring.push_back(msg);
+      _head++;
+      trim();
+    }
+    enqueued.fetch_add(1, std::memory_order_relaxed);
+    consumers.notify();
+    return true;
+  }
+
+  // appends up to max unread messages to held and their values to values,
+  // a reference is kept on each until released
+  size_t read(Subscriber &sub, std::vector<BroadcastMessage *> &held, std::vector<SHVar> &values, size_t max) {
+    size_t count = 0;
+    {
+      std::scoped_lock<std::mutex> lock(_mutex);
+      while (count < max && sub.cursor < _head) {
+        auto msg = _ring[sub.cursor - _base];
+        msg->refcount++;
+        held.push_back(msg);
+        values.push_back(msg->value);
+        sub.cursor++;
+        count++;
+      }
+      if (count > 0)
+        trim();
+    }
+    if (count > 0) {
+      dequeued.fetch_add(count, std::memory_order_relaxed);
+      if (policy == SlowListener::Block)
+        producers.notify();
+    }
+    return count;
+  }
+
+  // messages still waiting for some listener
+  size_t depth() {
+    std::scoped_lock<std::mutex> lock(_mutex);
+    return _ring.size();
+  }
+
+  const size_t capacity;
+  const SlowListener policy;
+
+  Waiters consumers;
+  Waiters producers;
+
+private:
+  // drops messages every listener already read, and listeners that are gone
+  void trim() {
+    auto oldest = _head;
+    for (auto it = _subscribers.begin(); it != _subscribers.end();) {
+      auto &sub = **it;
+      if (sub.closed) {
+        it = _subscribers.erase(it);
+      } else {
+        if (!sub.disconnected && sub.cursor < oldest)
+          oldest = sub.cursor;
+        ++it;
+      }
+    }
+    while (_base < oldest) {
+      release(_ring.front());
+      _ring.pop_front();
+      _base++;
+    }
+  }
+
+  std::mutex _mutex;
+  std::list<std::shared_ptr<Subscriber>> _subscribers;
+  std::deque<BroadcastMessage *> _ring;
+  uint64_t _base{0}; // sequence of _ring.front()
+  uint64_t _head{0}; // sequence of the next message
+  boost::lockfree::stack<BroadcastMessage *> _recycle{16};
   bool _noCopy = false;
 };
 
 using Channel = std::variant<DummyChannel, MPMCChannel, BroadcastChannel>;
 
+// Channels are resolved by name at compose time, shards keep the returned handle.
+// The registry is split in buckets so concurrent composes (TryMany/Expand doppelgangers)
+// rarely contend, and finding an existing channel only takes a shared lock.
 class Globals {
 private:
-  static inline std::mutex ChannelsMutex;
-  static inline std::unordered_map<std::string, Channel> Channels;
+  static constexpr size_t NumBuckets = 16;
+
+  struct Bucket {
+    std::shared_mutex mutex;
+    std::unordered_map<std::string, Channel> channels;
+  };
+
+  static inline std::array<Bucket, NumBuckets> Buckets;
 
 public:
+  // the handle stays valid for the whole process, channels are never removed
   static Channel &get(const std::string &name) {
-    std::scoped_lock<std::mutex> lock(ChannelsMutex);
-    return Channels[name];
+    auto &bucket = Buckets[std::hash<std::string>()(name) % NumBuckets];
+    {
+      std::shared_lock<std::shared_mutex> lock(bucket.mutex);
+      auto it = bucket.channels.find(name);
+      if (it != bucket.channels.end())
+        return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock(bucket.mutex);
+    return bucket.channels[name];
   }
 };
 
@@ -79,12 +330,18 @@ struct Base {
   Channel *_channel = nullptr;
   std::string _name;
   bool _noCopy = false;
+  int64_t _capacity = 0;
 
-  static inline Parameters producerParams{{"Name", SHCCSTR("The name of the channel."), {CoreInfo::StringType}},
-                                          {"NoCopy!!",
-                                           SHCCSTR("Unsafe flag that will improve performance by not copying "
-                                                   "values when sending them thru the channel."),
-                                           {CoreInfo::BoolType}}};
+  static inline Parameters producerParams{
+      {"Name", SHCCSTR("The name of the channel."), {CoreInfo::StringType}},
+      {"NoCopy!!",
+       SHCCSTR("Unsafe flag that will improve performance by not copying "
+               "values when sending them thru the channel."),
+       {CoreInfo::BoolType}},
+      {"Capacity",
+       SHCCSTR("The maximum amount of values the channel can hold, when full producers will wait for consumers. 0 "
+               "means unbounded."),
+       {CoreInfo::IntType}}};
 
   static inline Parameters consumerParams{
       {"Name", SHCCSTR("The name of the channel."), {CoreInfo::StringType}},
@@ -98,6 +355,9 @@ struct Base {
     case 1: {
       _noCopy = value.payload.boolValue;
     } break;
+    case 2: {
+      _capacity = value.payload.intValue;
+    } break;
     default:
       break;
     }
@@ -109,6 +369,8 @@ struct Base {
       return Var(_name);
     case 1:
       return Var(_noCopy);
+    case 2:
+      return Var(_capacity);
     }
     return SHVar();
   }
@@ -118,6 +380,33 @@ struct Base {
       throw SHException("Produce attempted to change produced type: " + _name);
     }
   }
+
+  template <typename T> void verifyCapacity(T &channel) {
+    if (_capacity > 0 && size_t(_capacity) != channel.capacity) {
+      throw SHException("Channel capacity mismatch: " + _name);
+    }
+  }
+
+  // retries attempt until it succeeds, parking the flow in between
+  // returns false if the wire was stopped or the channel completed while waiting
+  template <typename F>
+  static bool retry(SHContext *context, const ChannelShared &channel, Waiters &waiters, F attempt) {
+    bool waiting = false;
+    while (!attempt()) {
+      if (channel.closed)
+        return false;
+      // register before retrying so a change in between can't be missed
+      if (!waiting) {
+        waiters.add(context);
+        waiting = true;
+        continue;
+      }
+      waiting = false;
+      if (shards::park(context) != SHWireState::Continue)
+        return false;
+    }
+    return true;
+  }
 };
 
 struct Produce : public Base {
@@ -130,10 +419,13 @@ struct Produce : public Base {
   static SHParametersInfo parameters() { return producerParams; }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    if (_capacity < 0)
+      throw ComposeError("Produce: Capacity cannot be negative");
+
     auto &vchannel = Globals::get(_name);
     switch (vchannel.index()) {
     case 0: {
-      vchannel.emplace<MPMCChannel>(_noCopy);
+      vchannel.emplace<MPMCChannel>(_noCopy, size_t(_capacity));
       auto &channel = std::get<MPMCChannel>(vchannel);
       // no cloning here, this is potentially dangerous if the type is dynamic
       channel.type = data.inputType;
@@ -142,6 +434,7 @@ struct Produce : public Base {
     case 1: {
       auto &channel = std::get<MPMCChannel>(vchannel);
       verifyInputType(channel, data);
+      verifyCapacity(channel);
       _mpchannel = &channel;
     } break;
     default:
@@ -168,29 +461,60 @@ struct Produce : public Base {
       cloneVar(tmp, input);
     }
 
-    // enqueue for the stealing
-    _mpchannel->data.push(tmp);
+    // enqueue for the stealing, waiting for room if bounded
+    if (!retry(context, *_mpchannel, _mpchannel->producers, [&]() { return _mpchannel->push(tmp); })) {
+      // completed or stopped while waiting for room
+      _mpchannel->recycle.push(tmp);
+    }
 
     return input;
   }
 };
 
 struct Broadcast : public Base {
+  typedef EnumInfo<SlowListener> SlowListenerInfo;
+  static inline SlowListenerInfo slowListenerInfo{"SlowListener", CoreCC, 'slwL'};
+  static inline Type SlowListenerType{{SHType::Enum, {.enumeration = {.vendorId = CoreCC, .typeId = 'slwL'}}}};
+
+  static inline Parameters broadcastParams{
+      producerParams,
+      {{"SlowListener",
+        SHCCSTR("What to do when a listener falls Capacity values behind, only used when creating a bounded channel."),
+        {SlowListenerType}}}};
+
   BroadcastChannel *_mpchannel;
+  SlowListener _policy{SlowListener::Block};
 
   static SHTypesInfo inputTypes() { return CoreInfo::AnyType; }
 
   static SHTypesInfo outputTypes() { return CoreInfo::AnyType; }
 
-  static SHParametersInfo parameters() { return producerParams; }
+  static SHParametersInfo parameters() { return broadcastParams; }
+
+  void setParam(int index, const SHVar &value) {
+    if (index == 3)
+      _policy = SlowListener(value.payload.enumValue);
+    else
+      Base::setParam(index, value);
+  }
+
+  SHVar getParam(int index) {
+    if (index == 3)
+      return Var::Enum(_policy, CoreCC, 'slwL');
+    else
+      return Base::getParam(index);
+  }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    if (_capacity < 0)
+      throw ComposeError("Broadcast: Capacity cannot be negative");
+
     auto &vchannel = Globals::get(_name);
     switch (vchannel.index()) {
     case 0: {
       SHLOG_TRACE("Creating broadcast channel: {}", _name);
 
-      vchannel.emplace<BroadcastChannel>(_noCopy);
+      vchannel.emplace<BroadcastChannel>(_noCopy, size_t(_capacity), _policy);
       auto &channel = std::get<BroadcastChannel>(vchannel);
       // no cloning here, this is potentially dangerous if the type is dynamic
       channel.type = data.inputType;
@@ -201,6 +525,7 @@ struct Broadcast : public Base {
 
       auto &channel = std::get<BroadcastChannel>(vchannel);
       verifyInputType(channel, data);
+      verifyCapacity(channel);
       _mpchannel = &channel;
     } break;
     default:
@@ -212,33 +537,18 @@ struct Broadcast : public Base {
   SHVar activate(SHContext *context, const SHVar &input) {
     assert(_mpchannel);
 
-    // we need to support subscriptions during run-time
-    // so we need to lock this operation
-    // furthermore we allow multiple broadcasters so the erase needs this
-    std::scoped_lock<std::mutex> lock(_mpchannel->submutex);
-    for (auto it = _mpchannel->subscribers.begin(); it != _mpchannel->subscribers.end();) {
-      if (it->closed) {
-        it = _mpchannel->subscribers.erase(it);
-      } else {
-        SHVar tmp{};
-
-        // try to get from recycle bin
-        // this might fail but we don't care//
-        // if it fails will just allocate a brand new
-        it->recycle.pop(tmp);
-
-        if (_noCopy) {
-          tmp = input;
-        } else {
-          // this internally will reuse memory
-          cloneVar(tmp, input);
-        }
-
-        // enqueue for the stealing
-        it->data.push(tmp);
+    // a single copy shared by all listeners
+    auto msg = _mpchannel->acquire();
+    if (_noCopy) {
+      msg->value = input;
+    } else {
+      // this internally will reuse memory
+      cloneVar(msg->value, input);
+    }
 
-        ++it;
-      }
+    if (!retry(context, *_mpchannel, _mpchannel->producers, [&]() { return _mpchannel->publish(msg); })) {
+      // completed or stopped while waiting for a slow listener
+      _mpchannel->discard(msg);
     }
 
     return input;
@@ -278,10 +588,9 @@ struct BufferedConsumer {
 };
 
 struct Consumers : public Base {
-  MPMCChannel *_mpchannel;
+  MPMCChannel *_mpchannel = nullptr;
   BufferedConsumer _storage;
   int64_t _bufferSize = 1;
-  int64_t _current = 1;
   SHTypeInfo _outType{};
   SHTypeInfo _seqType{};
 
@@ -306,12 +615,62 @@ struct Consumers : public Base {
   }
 
   void cleanup() {
-    // reset buffer counter
-    _current = _bufferSize;
     // cleanup storage
     if (_mpchannel)
       _storage.recycle(_mpchannel);
   }
+
+  SHTypeInfo composeOutput(const char *shardName) {
+    if (_bufferSize < 1)
+      throw ComposeError(std::string(shardName) + ": Buffer must be at least 1");
+
+    _storage.buffer.reserve(size_t(_bufferSize));
+    if (_bufferSize == 1) {
+      return _outType;
+    } else {
+      _seqType.basicType = Seq;
+      _seqType.seqTypes.elements = &_outType;
+      _seqType.seqTypes.len = 1;
+      return _seqType;
+    }
+  }
+
+  // Fills the buffer popping as many values as available at once,
+  // the flow is parked while the channel is empty and woken by producers.
+  SHVar receive(SHContext *context, const ChannelShared &source) {
+    // send previous values to recycle
+    _storage.recycle(_mpchannel);
+
+    auto needed = size_t(_bufferSize);
+    bool waiting = false;
+    while (true) {
+      needed -= _mpchannel->pop(_storage.buffer, needed);
+      if (needed == 0)
+        return _storage;
+
+      // check also for channel completion
+      if (source.closed) {
+        // values might have been pushed right before completing
+        needed -= _mpchannel->pop(_storage.buffer, needed);
+        if (!_storage.empty()) {
+          return _storage;
+        } else {
+          context->stopFlow(Var::Empty);
+          return Var::Empty;
+        }
+      }
+
+      // register before retrying so a push in between can't be missed
+      if (!waiting) {
+        _mpchannel->consumers.add(context);
+        waiting = true;
+        continue;
+      }
+      waiting = false;
+      if (shards::park(context) != SHWireState::Continue)
+        return Var::Empty;
+    }
+  }
 };
 
 struct Consume : public Consumers {
@@ -322,14 +681,7 @@ struct Consume : public Consumers {
       auto &channel = std::get<MPMCChannel>(vchannel);
       _mpchannel = &channel;
       _outType = channel.type;
-      if (_bufferSize == 1) {
-        return _outType;
-      } else {
-        _seqType.basicType = Seq;
-        _seqType.seqTypes.elements = &_outType;
-        _seqType.seqTypes.len = 1;
-        return _seqType;
-      }
+      return composeOutput("Consume");
     };
     default:
       throw SHException("Produce/Consume channel type expected.");
@@ -338,51 +690,51 @@ struct Consume : public Consumers {
 
   SHVar activate(SHContext *context, const SHVar &input) {
     assert(_mpchannel);
+    return receive(context, *_mpchannel);
+  }
+};
 
-    // send previous values to recycle
-    _storage.recycle(_mpchannel);
-
-    // reset buffer
-    _current = _bufferSize;
-
-    // everytime we are scheduled we try to pop a value
-    while (_current--) {
-      SHVar output{};
-      while (!_mpchannel->data.pop(output)) {
-        // check also for channel completion
-        if (_mpchannel->closed) {
-          if (!_storage.empty()) {
-            return _storage;
-          } else {
-            context->stopFlow(Var::Empty);
-            return Var::Empty;
-          }
-        }
-        SH_SUSPEND(context, 0);
-      }
+struct Listen : public Consumers {
+  BroadcastChannel *_bchannel = nullptr;
+  std::shared_ptr<BroadcastChannel::Subscriber> _subscription;
+  // messages referenced by the current output
+  std::vector<BroadcastMessage *> _held;
+
+  void releaseHeld() {
+    for (auto msg : _held) {
+      _bchannel->release(msg);
+    }
+    _held.clear();
+    _storage.buffer.clear();
+  }
 
-      // keep for recycling
-      _storage.add(output);
+  void unsubscribe() {
+    if (_subscription) {
+      _subscription->closed = true;
+      _subscription.reset();
+      // a broadcaster might be waiting for this listener
+      _bchannel->producers.notify();
     }
+  }
 
-    return _storage;
+  void warmup(SHContext *context) {
+    // messages broadcasted from now on are received even before the first activation
+    if (_bchannel && !_subscription)
+      _subscription = _bchannel->subscribe();
   }
-};
 
-struct Listen : public Consumers {
-  BroadcastChannel *_bchannel;
+  void cleanup() {
+    // a stopped listener should not hold back broadcasters, subscribes again on warmup
+    if (_bchannel) {
+      releaseHeld();
+      unsubscribe();
+    }
+  }
 
   void destroy() {
-    if (_mpchannel) {
-      _mpchannel->closed = true;
-      // also try clear here, to make broadcast removal faster
-      SHVar tmp{};
-      while (_mpchannel->data.pop(tmp)) {
-        destroyVar(tmp);
-      }
-      while (_mpchannel->recycle.pop(tmp)) {
-        destroyVar(tmp);
-      }
+    if (_bchannel) {
+      releaseHeld();
+      unsubscribe();
     }
   }
 
@@ -392,19 +744,18 @@ struct Listen : public Consumers {
     case 2: {
       SHLOG_TRACE("Listening broadcast channel: {}", _name);
 
+      // composing again, drop the previous subscription
+      if (_bchannel) {
+        releaseHeld();
+        unsubscribe();
+      }
+
+      // subscribing is left to warmup, a wire that is composed but never run
+      // (e.g. a doppelganger master) must not hold back the ring
       auto &channel = std::get<BroadcastChannel>(vchannel);
-      auto &sub = channel.subscribe();
       _bchannel = &channel;
-      _mpchannel = &sub;
       _outType = channel.type;
-      if (_bufferSize == 1) {
-        return _outType;
-      } else {
-        _seqType.basicType = Seq;
-        _seqType.seqTypes.elements = &_outType;
-        _seqType.seqTypes.len = 1;
-        return _seqType;
-      }
+      return composeOutput("Listen");
     };
     default:
       throw SHException("Listen: channel type expected.");
@@ -413,35 +764,45 @@ struct Listen : public Consumers {
 
   SHVar activate(SHContext *context, const SHVar &input) {
     assert(_bchannel);
-    assert(_mpchannel);
 
-    // send previous values to recycle
-    _storage.recycle(_mpchannel);
+    if (unlikely(!_subscription))
+      _subscription = _bchannel->subscribe();
 
-    // reset buffer
-    _current = _bufferSize;
-
-    // everytime we are scheduled we try to pop a value
-    while (_current--) {
-      SHVar output{};
-      while (!_mpchannel->data.pop(output)) {
-        // check also for channel completion
-        if (_bchannel->closed) {
-          if (!_storage.empty()) {
-            return _storage;
-          } else {
-            context->stopFlow(Var::Empty);
-            return Var::Empty;
-          }
+    // previous output is no longer used
+    releaseHeld();
+
+    auto needed = size_t(_bufferSize);
+    bool waiting = false;
+    while (true) {
+      if (_subscription->disconnected)
+        throw ActivationError("Listen: disconnected from broadcast channel " + _name + ", too slow");
+
+      needed -= _bchannel->read(*_subscription, _held, _storage.buffer, needed);
+      if (needed == 0)
+        return _storage;
+
+      // check also for channel completion
+      if (_bchannel->closed) {
+        // values might have been broadcasted right before completing
+        needed -= _bchannel->read(*_subscription, _held, _storage.buffer, needed);
+        if (!_storage.empty()) {
+          return _storage;
+        } else {
+          context->stopFlow(Var::Empty);
+          return Var::Empty;
         }
-        SH_SUSPEND(context, 0);
       }
 
-      // keep for recycling
-      _storage.add(output);
+      // register before retrying so a broadcast in between can't be missed
+      if (!waiting) {
+        _bchannel->consumers.add(context);
+        waiting = true;
+        continue;
+      }
+      waiting = false;
+      if (shards::park(context) != SHWireState::Continue)
+        return Var::Empty;
     }
-
-    return _storage;
   }
 };
 
@@ -468,6 +829,7 @@ struct Complete : public Base {
     default:
       throw SHException("Expected a valid channel.");
     }
+    _channel = &vchannel;
     return data.inputType;
   }
 
@@ -478,16 +840,93 @@ struct Complete : public Base {
       SHLOG_INFO("Complete called on an already closed channel: {}", _name);
     }
 
+    // parked consumers and producers need to notice
+    if (auto mpmc = std::get_if<MPMCChannel>(_channel)) {
+      mpmc->consumers.notify();
+      mpmc->producers.notify();
+    } else if (auto broadcast = std::get_if<BroadcastChannel>(_channel)) {
+      broadcast->consumers.notify();
+      broadcast->producers.notify();
+    }
+
     return input;
   }
 };
 
+struct Stats : public Base {
+  static inline Parameters statsParams{{"Name", SHCCSTR("The name of the channel."), {CoreInfo::StringType}}};
+
+  static inline std::array<SHString, 6> OutputKeys{"Depth", "Enqueued", "Dequeued", "Drops", "EnqueueRate", "DequeueRate"};
+  static inline Types OutputTypes{{CoreInfo::IntType, CoreInfo::IntType, CoreInfo::IntType, CoreInfo::IntType,
+                                   CoreInfo::FloatType, CoreInfo::FloatType}};
+  static inline Type OutputType = Type::TableOf(OutputTypes, OutputKeys);
+
+  TableVar _output{};
+  SHTime _lastTime{};
+  uint64_t _lastEnqueued{0};
+  uint64_t _lastDequeued{0};
+
+  static SHTypesInfo inputTypes() { return CoreInfo::AnyType; }
+
+  static SHTypesInfo outputTypes() { return OutputType; }
+
+  static SHParametersInfo parameters() { return statsParams; }
+
+  SHTypeInfo compose(const SHInstanceData &data) {
+    // the channel might not be created yet, the handle will see it once it is
+    _channel = &Globals::get(_name);
+    return OutputType;
+  }
+
+  void warmup(SHContext *context) {
+    _lastTime = SHClock::now();
+    _lastEnqueued = 0;
+    _lastDequeued = 0;
+  }
+
+  SHVar activate(SHContext *context, const SHVar &input) {
+    assert(_channel);
+
+    int64_t depth = 0;
+    ChannelShared *channel = nullptr;
+    if (auto mpmc = std::get_if<MPMCChannel>(_channel)) {
+      depth = int64_t(mpmc->depth());
+      channel = mpmc;
+    } else if (auto broadcast = std::get_if<BroadcastChannel>(_channel)) {
+      depth = int64_t(broadcast->depth());
+      channel = broadcast;
+    }
+
+    uint64_t enqueued = channel ? channel->enqueued.load(std::memory_order_relaxed) : 0;
+    uint64_t dequeued = channel ? channel->dequeued.load(std::memory_order_relaxed) : 0;
+    uint64_t drops = channel ? channel->drops.load(std::memory_order_relaxed) : 0;
+
+    // rates are per second since the previous activation
+    auto now = SHClock::now();
+    auto elapsed = SHDuration(now - _lastTime).count();
+    double enqueueRate = elapsed > 0.0 ? double(enqueued - _lastEnqueued) / elapsed : 0.0;
+    double dequeueRate = elapsed > 0.0 ? double(dequeued - _lastDequeued) / elapsed : 0.0;
+    _lastTime = now;
+    _lastEnqueued = enqueued;
+    _lastDequeued = dequeued;
+
+    _output["Depth"] = Var(depth);
+    _output["Enqueued"] = Var(int64_t(enqueued));
+    _output["Dequeued"] = Var(int64_t(dequeued));
+    _output["Drops"] = Var(int64_t(drops));
+    _output["EnqueueRate"] = Var(enqueueRate);
+    _output["DequeueRate"] = Var(dequeueRate);
+    return _output;
+  }
+};
+
 void registerShards() {
   REGISTER_SHARD("Produce", Produce);
   REGISTER_SHARD("Broadcast", Broadcast);
   REGISTER_SHARD("Consume", Consume);
   REGISTER_SHARD("Listen", Listen);
   REGISTER_SHARD("Complete", Complete);
+  REGISTER_SHARD("Channel.Stats", Stats);
 }
 } // namespace channels
 } // namespace shards
@@ -196,6 +196,13 @@ struct Sort : public ActionJointOp {
     throw SHException("From variable not found!");
 
   found:
+    if (info.exposedType.basicType == SHType::Array) {
+      if (_blks || _columns.valueType != None)
+        throw ComposeError("Sort: Key and Join are not supported on arrays.");
+      OVERRIDE_ACTIVATE(data, activateArray);
+      return info.exposedType;
+    }
+
     // need to replace input type of inner wire with inner of seq
     if (info.exposedType.seqTypes.len != 1)
       throw SHException("From variable is not a single type Seq.");
@@ -270,6 +277,38 @@ struct Sort : public ActionJointOp {
     }
   }
 
+  // arrays are sorted directly on their payloads, stable like the insertion sort
+  template <typename Less> void sortArray(Less less) {
+    auto &array = _input->payload.arrayValue;
+    if (!_desc)
+      std::stable_sort(array.elements, array.elements + array.len, less);
+    else
+      std::stable_sort(array.elements, array.elements + array.len,
+                       [&](const SHVarPayload &a, const SHVarPayload &b) { return less(b, a); });
+  }
+
+  SHVar activateArray(SHContext *context, const SHVar &input) {
+    const auto innerType = _input->innerType;
+    switch (innerType) {
+    case Int:
+      sortArray([](const SHVarPayload &a, const SHVarPayload &b) { return a.intValue < b.intValue; });
+      break;
+    case Float:
+      sortArray([](const SHVarPayload &a, const SHVarPayload &b) { return a.floatValue < b.floatValue; });
+      break;
+    default:
+      sortArray([=](const SHVarPayload &a, const SHVarPayload &b) {
+        SHVar va{}, vb{};
+        va.valueType = vb.valueType = innerType;
+        va.payload = a;
+        vb.payload = b;
+        return va < vb;
+      });
+      break;
+    }
+    return *_input;
+  }
+
   SHVar activate(SHContext *context, const SHVar &input) {
     JointOp::ensureJoinSetup(context);
     // Sort in plac
@@ -782,7 +821,9 @@ private:
 };
 
 struct Reduce {
-  SHTypesInfo inputTypes() { return CoreInfo::AnySeqType; }
+  static inline Types InputTypes{{CoreInfo::AnySeqType, CoreInfo::AnyArrayType}};
+
+  SHTypesInfo inputTypes() { return InputTypes; }
 
   SHTypesInfo outputTypes() { return CoreInfo::AnyType; }
 
@@ -795,16 +836,26 @@ struct Reduce {
   void destroy() { destroyVar(_output); }
 
   SHTypeInfo compose(const SHInstanceData &data) {
-    if (data.inputType.seqTypes.len != 1) {
-      throw SHException("Reduce: Invalid sequence inner type, must be a single "
-                        "defined type.");
+    if (data.inputType.basicType == SHType::Array) {
+      if (data.inputType.innerType == SHType::None) {
+        throw SHException("Reduce: Invalid array inner type, must be a defined type.");
+      }
+      _itemType = Type({data.inputType.innerType});
+      OVERRIDE_ACTIVATE(data, activateArray);
+    } else {
+      if (data.inputType.seqTypes.len != 1) {
+        throw SHException("Reduce: Invalid sequence inner type, must be a single "
+                          "defined type.");
+      }
+      _itemType = Type(data.inputType.seqTypes.elements[0]);
+      OVERRIDE_ACTIVATE(data, activate);
     }
     // we need to edit a copy of data
     SHInstanceData dataCopy = data;
     // we need to deep copy it
     dataCopy.shared = {};
     DEFER({ arrayFree(dataCopy.shared); });
-    dataCopy.inputType = data.inputType.seqTypes.elements[0];
+    dataCopy.inputType = _itemType;
     // copy killing any existing $0
     for (uint32_t i = data.shared.len; i > 0; i--) {
       auto idx = i - 1;
@@ -849,9 +900,32 @@ struct Reduce {
     return _output;
   }
 
+  SHVar activateArray(SHContext *context, const SHVar &input) {
+    const auto &array = input.payload.arrayValue;
+    if (array.len == 0) {
+      throw ActivationError("Reduce: Input array was empty!");
+    }
+    SHVar item{};
+    item.valueType = input.innerType;
+    item.payload = array.elements[0];
+    cloneVar(*_tmp, item);
+    SHVar output{};
+    for (uint32_t i = 1; i < array.len; i++) {
+      item.payload = array.elements[i];
+      // allow short circut with (Return)
+      auto state = _shards.activate<true>(context, item, output);
+      if (state != SHWireState::Continue)
+        break;
+      cloneVar(*_tmp, output);
+    }
+    cloneVar(_output, *_tmp);
+    return _output;
+  }
+
 private:
   static inline Parameters _params{{"Apply", SHCCSTR("The function to apply to each item of the sequence."), {CoreInfo::Shards}}};
 
+  Type _itemType{};
   SHVar *_tmp = nullptr;
   SHVar _output{};
   ShardsVar _shards{};
@@ -901,6 +975,7 @@ struct Erase : SeqUser {
   }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    composeSlot(data);
     bool valid = false;
     _isTable = data.inputType.basicType == Table;
     // Figure if we output a sequence or not
@@ -1064,10 +1139,7 @@ struct Assoc : public VariableBase {
   // }
 
   void warmup(SHContext *context) {
-    if (_global)
-      _target = referenceGlobalVariable(context, _name.c_str());
-    else
-      _target = referenceVariable(context, _name.c_str());
+    _target = referenceTarget(context);
     _key.warmup(context);
   }
 
@@ -1663,6 +1735,7 @@ RUNTIME_SHARD_parameters(Slice);
 RUNTIME_SHARD_compose(Slice);
 RUNTIME_SHARD_setParam(Slice);
 RUNTIME_SHARD_getParam(Slice);
+RUNTIME_SHARD_warmup(Slice);
 RUNTIME_SHARD_activate(Slice);
 RUNTIME_SHARD_END(Slice);
 
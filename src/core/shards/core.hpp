@@ -588,6 +588,7 @@ struct VariableBase {
   ExposedInfo _exposedInfo{};
   bool _isTable{false};
   bool _global{false};
+  VariableSlot _slot{};
 
   static inline ParamsInfo variableParamsInfo =
       ParamsInfo(ParamsInfo::Param("Name", SHCCSTR("The name of the variable."), CoreInfo::StringOrAnyVar),
@@ -604,6 +605,18 @@ struct VariableBase {
 
   static SHParametersInfo parameters() { return SHParametersInfo(variableParamsInfo); }
 
+  void composeSlot(const SHInstanceData &data) {
+    if (!_global)
+      _slot = composeVariableSlot(data.wire, _name.c_str());
+  }
+
+  SHVar *referenceTarget(SHContext *context) {
+    if (_global)
+      return referenceGlobalVariable(context, _name.c_str());
+    else
+      return referenceVariable(context, _slot, _name.c_str());
+  }
+
   void cleanup() {
     if (_target) {
       releaseVariable(_target);
@@ -693,10 +706,7 @@ struct SetBase : public VariableBase {
   }
 
   void warmup(SHContext *context) {
-    if (_global)
-      _target = referenceGlobalVariable(context, _name.c_str());
-    else
-      _target = referenceVariable(context, _name.c_str());
+    _target = referenceTarget(context);
     _key.warmup(context);
   }
 
@@ -747,6 +757,7 @@ struct Set : public SetBase {
   static SHOptionalString outputHelp() { return SHCCSTR("The input to this shard is passed through as its output."); }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    composeSlot(data);
     sanityChecks(data, true);
 
     // bake exposed types
@@ -795,6 +806,7 @@ struct Ref : public SetBase {
   static SHOptionalString outputHelp() { return SHCCSTR("The input to this shard is passed through as its output."); }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    composeSlot(data);
     sanityChecks(data, true);
 
     // bake exposed types
@@ -895,6 +907,7 @@ struct Update : public SetBase {
   static SHOptionalString outputHelp() { return SHCCSTR("The input to this shard is passed through as its output."); }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    composeSlot(data);
     sanityChecks(data, false);
 
     // make sure we update to the same type
@@ -965,6 +978,14 @@ struct Get : public VariableBase {
   std::vector<SHString> _tableKeys{};
   Shard *_shard{nullptr};
 
+  // set by compiled wires when followed by Math.Add and Update on the same variable
+  // once the cell is pinned the three shards run as FusedGetAddUpdate
+  Shard *_fusedAdd{nullptr};
+  Shard *_fusedUpdate{nullptr};
+  SHVar _fusedOperand{};
+  SHInlineShards _fusedAddId{NotInline};
+  SHInlineShards _fusedUpdateId{NotInline};
+
   static inline shards::ParamsInfo getParamsInfo = shards::ParamsInfo(
       variableParamsInfo, shards::ParamsInfo::Param("Default",
                                                     SHCCSTR("The default value to use to infer types and output if the "
@@ -1000,7 +1021,11 @@ struct Get : public VariableBase {
   static SHOptionalString outputHelp() { return SHCCSTR("The output is the value read from the variable."); }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    composeSlot(data);
     _shard = const_cast<Shard *>(data.shard);
+    // compose of compiled wires might fuse again afterwards
+    _fusedAdd = nullptr;
+    _fusedUpdate = nullptr;
     if (_isTable) {
       for (uint32_t i = 0; data.shared.len > i; i++) {
         auto &name = data.shared.elements[i].name;
@@ -1131,10 +1156,7 @@ struct Get : public VariableBase {
   }
 
   void warmup(SHContext *context) {
-    if (_global)
-      _target = referenceGlobalVariable(context, _name.c_str());
-    else
-      _target = referenceVariable(context, _name.c_str());
+    _target = referenceTarget(context);
 
     _key.warmup(context);
   }
@@ -1144,9 +1166,32 @@ struct Get : public VariableBase {
     if (_shard) {
       _shard->inlineShardId = SHInlineShards::NotInline;
     }
+    if (_fusedAdd) {
+      _fusedAdd->inlineShardId = _fusedAddId;
+      _fusedUpdate->inlineShardId = _fusedUpdateId;
+    }
     VariableBase::cleanup();
   }
 
+  void fuse(Shard *add, const SHVar &operand, Shard *update) {
+    _fusedAdd = add;
+    _fusedUpdate = update;
+    _fusedOperand = operand;
+    _fusedAddId = SHInlineShards(add->inlineShardId);
+    _fusedUpdateId = SHInlineShards(update->inlineShardId);
+  }
+
+  // Get -> Math.Add -> Update in one go, the other two shards are noops meanwhile
+  // the output is the updated value, which is what Update would output
+  ALWAYS_INLINE SHVar activateFusedAdd() {
+    auto &value = *_cell;
+    if (value.valueType == SHType::Int)
+      value.payload.intValue += _fusedOperand.payload.intValue;
+    else
+      value.payload.floatValue += _fusedOperand.payload.floatValue;
+    return value;
+  }
+
   SHVar activate(SHContext *context, const SHVar &input) {
     if (unlikely(_cell != nullptr)) {
       // we override shard id, this should not happen
@@ -1194,6 +1239,13 @@ struct Get : public VariableBase {
         } else {
           // Pin fast cell
           _cell = _target;
+          if (_fusedAdd && value.valueType == _fusedOperand.valueType) {
+            // types are known now, run fused from here on
+            _shard->inlineShardId = SHInlineShards::FusedGetAddUpdate;
+            _fusedAdd->inlineShardId = SHInlineShards::NoopShard;
+            _fusedUpdate->inlineShardId = SHInlineShards::NoopShard;
+            return activateFusedAdd();
+          }
           // override shard internal id
           _shard->inlineShardId = SHInlineShards::CoreGet;
           return value;
@@ -1320,10 +1372,7 @@ struct SeqBase : public VariableBase {
   }
 
   void warmup(SHContext *context) {
-    if (_global)
-      _target = referenceGlobalVariable(context, _name.c_str());
-    else
-      _target = referenceVariable(context, _name.c_str());
+    _target = referenceTarget(context);
     _key.warmup(context);
     initSeq();
   }
@@ -1380,6 +1429,7 @@ struct Push : public SeqBase {
   }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    composeSlot(data);
     const auto updateSeqInfo = [this, &data] {
       _seqInfo.basicType = Seq;
       _seqInnerInfo = data.inputType;
@@ -1595,6 +1645,7 @@ struct Sequence : public SeqBase {
   }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    composeSlot(data);
     const auto updateTableInfo = [this] {
       _tableInfo.basicType = Table;
       if (_tableInfo.table.types.elements) {
@@ -1734,10 +1785,7 @@ struct TableDecl : public VariableBase {
   }
 
   void warmup(SHContext *context) {
-    if (_global)
-      _target = referenceGlobalVariable(context, _name.c_str());
-    else
-      _target = referenceVariable(context, _name.c_str());
+    _target = referenceTarget(context);
     _key.warmup(context);
     initTable();
   }
@@ -1867,6 +1915,7 @@ struct TableDecl : public VariableBase {
   }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    composeSlot(data);
     const auto updateTableInfo = [this] {
       _tableInfo.basicType = Table;
       if (_tableInfo.table.types.elements) {
@@ -1984,10 +2033,7 @@ struct SeqUser : VariableBase {
   }
 
   void warmup(SHContext *context) {
-    if (_global)
-      _target = referenceGlobalVariable(context, _name.c_str());
-    else
-      _target = referenceVariable(context, _name.c_str());
+    _target = referenceTarget(context);
     _key.warmup(context);
     initSeq();
   }
@@ -2157,6 +2203,7 @@ struct Pop : SeqUser {
   void destroy() { destroyVar(_output); }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    composeSlot(data);
     if (_isTable) {
       for (uint32_t i = 0; data.shared.len > i; i++) {
         if (data.shared.elements[i].name == _name && data.shared.elements[i].exposedType.table.types.elements) {
@@ -2231,6 +2278,7 @@ struct PopFront : SeqUser {
   void destroy() { destroyVar(_output); }
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    composeSlot(data);
     if (_isTable) {
       for (uint32_t i = 0; data.shared.len > i; i++) {
         if (data.shared.elements[i].name == _name && data.shared.elements[i].exposedType.table.types.elements) {
@@ -2315,6 +2363,10 @@ struct Take {
   ExposedInfo _exposedInfo{};
   bool _seqOutput{false};
   bool _tableOutput{false};
+  // constant indices (wrapped to unsigned, so negative ones are out of range) and table keys, hashed at compose
+  std::vector<size_t> _constantIndices;
+  size_t _maxConstantIndex{0};
+  std::vector<std::pair<std::string_view, uint64_t>> _constantKeys;
 
   SHVar _vectorOutput{};
   const VectorTypeTraits *_vectorInputType{nullptr};
@@ -2395,7 +2447,15 @@ struct Take {
       throw SHException("Take, invalid indices or malformed input.");
 
     if (data.inputType.basicType == Seq) {
-      OVERRIDE_ACTIVATE(data, activateSeq);
+      if (_indices.valueType == Int || _indices.valueType == Seq) {
+        collectConstantIndices();
+        if (_seqOutput)
+          OVERRIDE_ACTIVATE(data, activateSeqConstMulti);
+        else
+          OVERRIDE_ACTIVATE(data, activateSeqConst);
+      } else {
+        OVERRIDE_ACTIVATE(data, activateSeq);
+      }
       if (_seqOutput) {
         // multiple values, leave Seq
         return data.inputType;
@@ -2411,6 +2471,9 @@ struct Take {
       if (_vectorInputType) {
         if (_seqOutput)
           OVERRIDE_ACTIVATE(data, activateVector);
+        else if (_indices.valueType == Int && _indices.payload.intValue >= 0 &&
+                 _indices.payload.intValue < SHInt(_vectorInputType->dimension))
+          OVERRIDE_ACTIVATE(data, activateNumberConst);
         else
           OVERRIDE_ACTIVATE(data, activateNumber);
 
@@ -2453,7 +2516,14 @@ struct Take {
           return CoreInfo::StringType;
         }
       } else if (data.inputType.basicType == Table) {
-        OVERRIDE_ACTIVATE(data, activateTable);
+        if (collectConstantKeys()) {
+          if (_seqOutput)
+            OVERRIDE_ACTIVATE(data, activateTableConstMulti);
+          else
+            OVERRIDE_ACTIVATE(data, activateTableConst);
+        } else {
+          OVERRIDE_ACTIVATE(data, activateTable);
+        }
         if (data.inputType.table.keys.len > 0 && (_indices.valueType == String || _indices.valueType == Seq)) {
           // we can fully reconstruct a type in this case
           if (data.inputType.table.keys.len != data.inputType.table.types.len) {
@@ -2512,6 +2582,42 @@ struct Take {
     throw SHException("Take, invalid input type or not implemented.");
   }
 
+  void collectConstantIndices() {
+    _constantIndices.clear();
+    if (_indices.valueType == Int) {
+      _constantIndices.push_back(size_t(_indices.payload.intValue));
+    } else {
+      for (uint32_t i = 0; i < _indices.payload.seqValue.len; i++) {
+        _constantIndices.push_back(size_t(_indices.payload.seqValue.elements[i].payload.intValue));
+      }
+    }
+    _maxConstantIndex = 0;
+    for (auto index : _constantIndices)
+      _maxConstantIndex = std::max(_maxConstantIndex, index);
+  }
+
+  // false if the keys are not all constant strings
+  bool collectConstantKeys() {
+    _constantKeys.clear();
+    if (_indices.valueType == String) {
+      auto key = SHSTRVIEW(_indices);
+      _constantKeys.emplace_back(key, SHMap::hash(key));
+      return true;
+    } else if (_indices.valueType == Seq) {
+      for (uint32_t i = 0; i < _indices.payload.seqValue.len; i++) {
+        auto &record = _indices.payload.seqValue.elements[i];
+        if (record.valueType != String) {
+          _constantKeys.clear();
+          return false;
+        }
+        auto key = SHSTRVIEW(record);
+        _constantKeys.emplace_back(key, SHMap::hash(key));
+      }
+      return true;
+    }
+    return false;
+  }
+
   SHExposedTypesInfo requiredVariables() {
     if (_indices.valueType == ContextVar) {
       if (_seqOutput)
@@ -2530,6 +2636,8 @@ struct Take {
     switch (index) {
     case 0:
       cloneVar(_indices, value);
+      _constantIndices.clear();
+      _constantKeys.clear();
       cleanup();
       break;
     default:
@@ -2587,9 +2695,29 @@ struct Take {
   ACTIVATE_INDEXABLE(activateString, SHSTRLEN(input), shards::Var(input.payload.stringValue[index]))
   ACTIVATE_INDEXABLE(activateBytes, input.payload.bytesSize, shards::Var(input.payload.bytesValue[index]))
 
+  // constant indices, a single bounds check against the largest one
+  SHVar activateSeqConst(SHContext *context, const SHVar &input) {
+    const auto &seq = input.payload.seqValue;
+    if (unlikely(_maxConstantIndex >= seq.len)) {
+      throw OutOfRangeEx(seq.len, int64_t(_maxConstantIndex));
+    }
+    return seq.elements[_maxConstantIndex];
+  }
+
+  SHVar activateSeqConstMulti(SHContext *context, const SHVar &input) {
+    const auto &seq = input.payload.seqValue;
+    if (unlikely(_maxConstantIndex >= seq.len)) {
+      throw OutOfRangeEx(seq.len, int64_t(_maxConstantIndex));
+    }
+    const auto nindices = uint32_t(_constantIndices.size());
+    shards::arrayResize(_cachedSeq, nindices);
+    for (uint32_t i = 0; nindices > i; i++) {
+      _cachedSeq.elements[i] = seq.elements[_constantIndices[i]];
+    }
+    return shards::Var(_cachedSeq);
+  }
+
   SHVar activateTable(SHContext *context, const SHVar &input) {
-    // TODO, if the strings are static at compose time, make sure to cache the
-    // return value
     const auto &indices = _indicesVar ? *_indicesVar : _indices;
     if (!_seqOutput) {
       const auto key = indices.payload.stringValue;
@@ -2607,6 +2735,30 @@ struct Take {
     }
   }
 
+  // tables of this runtime are probed with the key hashed at compose, others go through the api
+  ALWAYS_INLINE const SHVar &tableAtConst(const SHTable &table, uint32_t index) {
+    const auto &[key, hash] = _constantKeys[index];
+    if (likely(table.api == &GetGlobals().TableInterface)) {
+      auto map = reinterpret_cast<SHMap *>(table.opaque);
+      auto it = map->find(key, hash);
+      if (likely(it != map->end()))
+        return it->second;
+    }
+    // keys are views of _indices strings, so null terminated
+    return *table.api->tableAt(table, key.data());
+  }
+
+  SHVar activateTableConst(SHContext *context, const SHVar &input) { return tableAtConst(input.payload.tableValue, 0); }
+
+  SHVar activateTableConstMulti(SHContext *context, const SHVar &input) {
+    const auto nkeys = uint32_t(_constantKeys.size());
+    shards::arrayResize(_cachedSeq, nkeys);
+    for (uint32_t i = 0; nkeys > i; i++) {
+      _cachedSeq.elements[i] = tableAtConst(input.payload.tableValue, i);
+    }
+    return Var(_cachedSeq);
+  }
+
   SHVar activateVector(SHContext *context, const SHVar &input) {
     const auto &indices = _indices;
 
@@ -2632,6 +2784,13 @@ struct Take {
     return _vectorOutput;
   }
 
+  // lane checked against the vector dimension at compose
+  SHVar activateNumberConst(SHContext *context, const SHVar &input) {
+    const uint8_t *inputPtr = (uint8_t *)&input.payload + _vectorConversion->inStride * _indices.payload.intValue;
+    _vectorConversion->convertOne(inputPtr, &_vectorOutput.payload);
+    return _vectorOutput;
+  }
+
   SHVar activate(SHContext *context, const SHVar &input) {
     // Take branches during validation into different inlined shards
     // If we hit this, maybe that type of input is not yet implemented
@@ -2661,13 +2820,24 @@ struct RTake : public Take {
   SHTypeInfo compose(const SHInstanceData &data) {
     SHTypeInfo result = Take::compose(data);
     if (data.inputType.basicType == Seq) {
-      OVERRIDE_ACTIVATE(data, activate);
+      if (_indices.valueType == Int)
+        OVERRIDE_ACTIVATE(data, activateConst);
+      else
+        OVERRIDE_ACTIVATE(data, activate);
     } else {
       throw SHException("RTake is only supported on sequence types");
     }
     return result;
   }
 
+  SHVar activateConst(SHContext *context, const SHVar &input) {
+    const auto &seq = input.payload.seqValue;
+    if (unlikely(_maxConstantIndex >= seq.len)) {
+      throw OutOfRangeEx(seq.len, int64_t(_maxConstantIndex));
+    }
+    return seq.elements[seq.len - 1 - _maxConstantIndex];
+  }
+
   SHVar activate(SHContext *context, const SHVar &input) {
     const auto inputLen = input.payload.seqValue.len;
     const auto &indices = _indicesVar ? *_indicesVar : _indices;
@@ -2789,10 +2959,17 @@ struct Slice {
     if (!valid)
       throw SHException("Slice, invalid To variable.");
 
+    // unit steps are plain views of the input
     if (data.inputType.basicType == Seq) {
-      OVERRIDE_ACTIVATE(data, activateSeq);
+      if (_step == 1)
+        OVERRIDE_ACTIVATE(data, activateSeqView);
+      else
+        OVERRIDE_ACTIVATE(data, activateSeq);
     } else if (data.inputType.basicType == Bytes) {
-      OVERRIDE_ACTIVATE(data, activateBytes);
+      if (_step == 1)
+        OVERRIDE_ACTIVATE(data, activateBytesView);
+      else
+        OVERRIDE_ACTIVATE(data, activateBytes);
     } else if (data.inputType.basicType == String) {
       OVERRIDE_ACTIVATE(data, activateString);
     }
@@ -2800,6 +2977,15 @@ struct Slice {
     return data.inputType;
   }
 
+  void warmup(SHContext *context) {
+    if (_from.valueType == ContextVar && !_fromVar) {
+      _fromVar = referenceVariable(context, _from.payload.stringValue);
+    }
+    if (_to.valueType == ContextVar && !_toVar) {
+      _toVar = referenceVariable(context, _to.payload.stringValue);
+    }
+  }
+
   SHExposedTypesInfo requiredVariables() {
     if (_from.valueType == ContextVar && _to.valueType == ContextVar) {
       _exposedInfo =
@@ -2856,15 +3042,8 @@ struct Slice {
     }
   };
 
-  SHVar activateBytes(SHContext *context, const SHVar &input) {
-    if (_from.valueType == ContextVar && !_fromVar) {
-      _fromVar = referenceVariable(context, _from.payload.stringValue);
-    }
-    if (_to.valueType == ContextVar && !_toVar) {
-      _toVar = referenceVariable(context, _to.payload.stringValue);
-    }
-
-    const auto inputLen = input.payload.bytesSize;
+  // resolves From/To against the input length
+  ALWAYS_INLINE std::pair<int64_t, int64_t> range(int64_t inputLen) {
     const auto &vfrom = _fromVar ? *_fromVar : _from;
     const auto &vto = _toVar ? *_toVar : _to;
     auto from = vfrom.payload.intValue;
@@ -2879,16 +3058,34 @@ struct Slice {
     if (from > to || to < 0 || to > inputLen) {
       throw OutOfRangeEx(inputLen, from, to);
     }
+    return {from, to};
+  }
+
+  SHVar activateSeqView(SHContext *context, const SHVar &input) {
+    const auto [from, to] = range(input.payload.seqValue.len);
+    SHVar output{};
+    output.valueType = Seq;
+    output.payload.seqValue.elements = &input.payload.seqValue.elements[from];
+    output.payload.seqValue.len = uint32_t(to - from);
+    return output;
+  }
 
+  SHVar activateBytesView(SHContext *context, const SHVar &input) {
+    const auto [from, to] = range(input.payload.bytesSize);
+    SHVar output{};
+    output.valueType = Bytes;
+    output.payload.bytesValue = &input.payload.bytesValue[from];
+    output.payload.bytesSize = uint32_t(to - from);
+    return output;
+  }
+
+  SHVar activateBytes(SHContext *context, const SHVar &input) {
+    const auto inputLen = input.payload.bytesSize;
+    const auto [from, to] = range(inputLen);
+
+    // unit steps go through activateBytesView
     const auto len = to - from;
-    if (_step == 1) {
-      // we don't need to copy anything in this case
-      SHVar output{};
-      output.valueType = Bytes;
-      output.payload.bytesValue = &input.payload.bytesValue[from];
-      output.payload.bytesSize = uint32_t(len);
-      return output;
-    } else if (_step > 1) {
+    if (_step > 1) {
       const auto actualLen = len / _step + (len % _step != 0);
       _cachedBytes.resize(actualLen);
       auto idx = 0;
@@ -2903,30 +3100,10 @@ struct Slice {
   }
 
   SHVar activateString(SHContext *context, const SHVar &input) {
-    if (_from.valueType == ContextVar && !_fromVar) {
-      _fromVar = referenceVariable(context, _from.payload.stringValue);
-    }
-    if (_to.valueType == ContextVar && !_toVar) {
-      _toVar = referenceVariable(context, _to.payload.stringValue);
-    }
-
     const auto inputLen = input.payload.stringLen > 0 || input.payload.stringValue == nullptr
                               ? input.payload.stringLen
                               : uint32_t(strlen(input.payload.stringValue));
-    const auto &vfrom = _fromVar ? *_fromVar : _from;
-    const auto &vto = _toVar ? *_toVar : _to;
-    auto from = vfrom.payload.intValue;
-    if (from < 0) {
-      from = inputLen + from;
-    }
-    auto to = vto.valueType == None ? inputLen : vto.payload.intValue;
-    if (to < 0) {
-      to = inputLen + to;
-    }
-
-    if (from > to || to < 0 || to > inputLen) {
-      throw OutOfRangeEx(inputLen, from, to);
-    }
+    const auto [from, to] = range(inputLen);
 
     const auto len = to - from;
     if (_step > 0) {
@@ -2945,38 +3122,12 @@ struct Slice {
   }
 
   SHVar activateSeq(SHContext *context, const SHVar &input) {
-    if (_from.valueType == ContextVar && !_fromVar) {
-      _fromVar = referenceVariable(context, _from.payload.stringValue);
-    }
-    if (_to.valueType == ContextVar && !_toVar) {
-      _toVar = referenceVariable(context, _to.payload.stringValue);
-    }
-
     const auto inputLen = input.payload.seqValue.len;
-    const auto &vfrom = _fromVar ? *_fromVar : _from;
-    const auto &vto = _toVar ? *_toVar : _to;
-    auto from = vfrom.payload.intValue;
-    if (from < 0) {
-      from = inputLen + from;
-    }
-    auto to = vto.valueType == None ? inputLen : vto.payload.intValue;
-    if (to < 0) {
-      to = inputLen + to;
-    }
-
-    if (from > to || to < 0 || to > inputLen) {
-      throw OutOfRangeEx(inputLen, from, to);
-    }
+    const auto [from, to] = range(inputLen);
 
+    // unit steps go through activateSeqView
     const auto len = to - from;
-    if (_step == 1) {
-      // we don't need to copy anything in this case
-      SHVar output{};
-      output.valueType = Seq;
-      output.payload.seqValue.elements = &input.payload.seqValue.elements[from];
-      output.payload.seqValue.len = uint32_t(len);
-      return output;
-    } else if (_step > 1) {
+    if (_step > 1) {
       const auto actualLen = len / _step + (len % _step != 0);
       shards::arrayResize(_cachedSeq, uint32_t(actualLen));
       auto idx = 0;
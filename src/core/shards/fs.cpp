@@ -2,6 +2,7 @@
 /* Copyright © 2019 Fragcolor Pte. Ltd. */
 
 #include "shared.hpp"
+#include "mapped_file.hpp"
 #include <boost/algorithm/string.hpp>
 #include <fstream>
 
@@ -181,6 +182,15 @@ struct Filename {
 struct Read {
   std::vector<uint8_t> _buffer;
   bool _binary = false;
+  bool _memoryMap = false;
+  int64_t _chunkSize = 0;
+
+  // the file being mapped or streamed, reopened if the input changes
+  std::string _path;
+  std::shared_ptr<MappedFile> _mapped;
+  std::time_t _mtime{};
+  std::ifstream _stream;
+  size_t _offset{0};
 
   static SHTypesInfo inputTypes() { return CoreInfo::StringType; }
   SHTypesInfo outputTypes() {
@@ -190,8 +200,18 @@ struct Read {
       return CoreInfo::StringType;
   }
 
-  static inline ParamsInfo params =
-      ParamsInfo(ParamsInfo::Param("Bytes", SHCCSTR("If the output should be Bytes instead of String."), CoreInfo::BoolType));
+  static inline ParamsInfo params = ParamsInfo(
+      ParamsInfo::Param("Bytes", SHCCSTR("If the output should be Bytes instead of String."), CoreInfo::BoolType),
+      ParamsInfo::Param("MemoryMap",
+                        SHCCSTR("If the file should be memory mapped, Bytes are then a view of the file rather than a "
+                                "copy. The output is valid until the next activation. The file is mapped again when its "
+                                "size or modification time changes, files of 4 GB or more require ChunkSize."),
+                        CoreInfo::BoolType),
+      ParamsInfo::Param("ChunkSize",
+                        SHCCSTR("If greater than 0 the file is streamed, each activation outputs the next ChunkSize "
+                                "bytes of it (String chunks might split multi-byte characters) and an empty output "
+                                "once the end of the file was reached, the activation after that starts over."),
+                        CoreInfo::IntType));
   static SHParametersInfo parameters() { return SHParametersInfo(params); }
 
   void setParam(int index, const SHVar &value) {
@@ -199,6 +219,12 @@ struct Read {
     case 0:
       _binary = bool(Var(value));
       break;
+    case 1:
+      _memoryMap = bool(Var(value));
+      break;
+    case 2:
+      _chunkSize = value.payload.intValue;
+      break;
     }
   }
 
@@ -206,19 +232,127 @@ struct Read {
     switch (index) {
     case 0:
       return Var(_binary);
+    case 1:
+      return Var(_memoryMap);
+    case 2:
+      return Var(_chunkSize);
     default:
       return Var::Empty;
     }
   }
 
+  void cleanup() {
+    _path.clear();
+    _mapped.reset();
+    _stream = {};
+    _offset = 0;
+  }
+
+  // Bytes and String lengths are 32 bits
+  static void checkSize(size_t size) {
+    if (size > size_t(UINT32_MAX))
+      throw ActivationError("FS.Read: file too large for a single value, use ChunkSize to stream it.");
+  }
+
+  SHVar output(const uint8_t *data, size_t size) {
+    checkSize(size);
+    if (_binary) {
+      return Var(const_cast<uint8_t *>(data), uint32_t(size));
+    } else {
+      _buffer.assign(data, data + size);
+      _buffer.push_back(0);
+      return Var((const char *)_buffer.data(), uint32_t(size));
+    }
+  }
+
+  SHVar mapped() {
+    if (_chunkSize > 0) {
+      auto size = std::min(size_t(_chunkSize), _mapped->size() - _offset);
+      if (size == 0) {
+        // the end was reached, start over on the next activation
+        cleanup();
+        return output(nullptr, 0);
+      }
+      auto data = _mapped->data() + _offset;
+      _offset += size;
+      return output(data, size);
+    }
+
+    checkSize(_mapped->size());
+    if (_binary) {
+      return Var(const_cast<uint8_t *>(_mapped->data()), uint32_t(_mapped->size()));
+    } else if (_mapped->nullTerminated()) {
+      return Var((const char *)_mapped->data(), uint32_t(_mapped->size()));
+    } else {
+      return output(_mapped->data(), _mapped->size());
+    }
+  }
+
+  SHVar streamed() {
+    checkSize(size_t(_chunkSize));
+    _buffer.resize(size_t(_chunkSize));
+    _stream.read((char *)_buffer.data(), _chunkSize);
+    if (_stream.bad()) {
+      SHLOG_ERROR("Failed to read file: {}", _path);
+      cleanup();
+      throw ActivationError("FS.Read, failed to read the file.");
+    }
+    auto size = size_t(_stream.gcount());
+    // the end was reached, start over on the next activation
+    if (size == 0)
+      cleanup();
+    if (_binary) {
+      return Var(_buffer.data(), uint32_t(size));
+    } else {
+      _buffer.resize(size);
+      _buffer.push_back(0);
+      return Var((const char *)_buffer.data(), uint32_t(size));
+    }
+  }
+
+  // a whole file view follows the file like a plain read does, a stream keeps reading what it opened
+  bool changed(const fs::path &p) const {
+    boost::system::error_code ec;
+    const auto size = fs::file_size(p, ec);
+    if (ec || size != _mapped->size())
+      return true;
+    const auto mtime = fs::last_write_time(p, ec);
+    return ec || mtime != _mtime;
+  }
+
   SHVar activate(SHContext *context, const SHVar &input) {
-    _buffer.clear();
     fs::path p(input.payload.stringValue);
-    if (!fs::exists(p)) {
+    auto reopen = (_memoryMap || _chunkSize > 0) && _path != input.payload.stringValue;
+    if (!reopen && _mapped && _chunkSize <= 0)
+      reopen = changed(p);
+    if ((reopen || (!_memoryMap && _chunkSize <= 0)) && !fs::exists(p)) {
       SHLOG_ERROR("File is missing: {}", p);
       throw ActivationError("FS.Read, file does not exist.");
     }
 
+    if (reopen) {
+      cleanup();
+      _path = input.payload.stringValue;
+      if (_memoryMap) {
+        _mtime = fs::last_write_time(p);
+        _mapped = MappedFile::open(_path);
+      } else {
+        _stream = std::ifstream(_path, std::ios::binary);
+        if (!_stream.is_open()) {
+          SHLOG_ERROR("Failed to open file: {}", p);
+          cleanup();
+          throw ActivationError("FS.Read, failed to open the file.");
+        }
+      }
+    }
+
+    if (_mapped) {
+      return mapped();
+    } else if (_chunkSize > 0) {
+      return streamed();
+    }
+
+    _buffer.clear();
     if (_binary) {
       std::ifstream file(p.string(), std::ios::binary);
       _buffer.assign(std::istreambuf_iterator<char>(file), {});
@@ -11,13 +11,25 @@ using json = nlohmann::json;
 void from_json(const json &j, SHWireRef &wire);
 void to_json(json &j, const SHWireRef &wire);
 
+// string storage goes through the runtime so that destroyVar can free it
+static void setString(SHVar &var, const std::string &str) {
+  const auto len = uint32_t(str.length());
+  uint32_t capacity;
+  auto buffer = shards::allocString(len, capacity);
+  memcpy(buffer, str.c_str(), len);
+  buffer[len] = 0;
+  var.payload.stringValue = buffer;
+  var.payload.stringLen = len;
+  var.payload.stringCapacity = capacity;
+}
+
 void _releaseMemory(SHVar &var) {
   // Used by Shard and Wire from_json
   switch (var.valueType) {
   case SHType::Path:
   case SHType::ContextVar:
   case SHType::String:
-    delete[] var.payload.stringValue;
+    shards::destroyString(var);
     break;
   case SHType::Image:
     delete[] var.payload.imageValue.data;
@@ -359,32 +371,17 @@ void from_json(const json &j, SHVar &var) {
   }
   case SHType::ContextVar: {
     var.valueType = SHType::ContextVar;
-    auto strVal = j.at("value").get<std::string>();
-    const auto strLen = strVal.length();
-    var.payload.stringValue = new char[strLen + 1];
-    var.payload.stringLen = uint32_t(strLen);
-    memcpy((void *)var.payload.stringValue, strVal.c_str(), strLen);
-    ((char *)var.payload.stringValue)[strLen] = 0;
+    setString(var, j.at("value").get<std::string>());
     break;
   }
   case SHType::String: {
     var.valueType = SHType::String;
-    auto strVal = j.at("value").get<std::string>();
-    const auto strLen = strVal.length();
-    var.payload.stringValue = new char[strLen + 1];
-    var.payload.stringLen = uint32_t(strLen);
-    memcpy((void *)var.payload.stringValue, strVal.c_str(), strLen);
-    ((char *)var.payload.stringValue)[strLen] = 0;
+    setString(var, j.at("value").get<std::string>());
     break;
   }
   case SHType::Path: {
     var.valueType = SHType::Path;
-    auto strVal = j.at("value").get<std::string>();
-    const auto strLen = strVal.length();
-    var.payload.stringValue = new char[strLen + 1];
-    var.payload.stringLen = uint32_t(strLen);
-    memcpy((void *)var.payload.stringValue, strVal.c_str(), strLen);
-    ((char *)var.payload.stringValue)[strLen] = 0;
+    setString(var, j.at("value").get<std::string>());
     break;
   }
   case SHType::Color: {
@@ -718,12 +715,7 @@ struct FromJson {
       storage.payload.floatValue = j.get<double>();
     } else if (j.is_string()) {
       storage.valueType = String;
-      auto strVal = j.get<std::string>();
-      const auto strLen = strVal.length();
-      storage.payload.stringValue = new char[strLen + 1];
-      storage.payload.stringLen = strLen;
-      memcpy((void *)storage.payload.stringValue, strVal.c_str(), strLen);
-      ((char *)storage.payload.stringValue)[strLen] = 0;
+      setString(storage, j.get<std::string>());
     } else if (j.is_boolean()) {
       storage.valueType = Bool;
       storage.payload.boolValue = j.get<bool>();
@@ -32,6 +32,25 @@ SHVar Cross::activate(SHContext *context, const SHVar &input) {
   return doActivate(context, input, op);
 }
 
+SHVar Cross::activateArray(SHContext *context, const SHVar &input) {
+  if (input.innerType != Float3)
+    throw ActivationError("LinAlg.Cross works only with Float3 types.");
+
+  auto &operand = _operand.get();
+  const auto len = arrayPairs(input, operand);
+  const auto &src = input.payload.arrayValue;
+  auto &dst = arrayOutput(_result, Float3, len);
+  const SHInt3 mask1 = {1, 2, 0};
+  const SHInt3 mask2 = {2, 0, 1};
+  for (uint32_t i = 0; i < len; i++) {
+    const auto &a = src.elements[i].float3Value;
+    const auto &b = arrayOperand(operand, i).float3Value;
+    dst.elements[i].float3Value =
+        shufflevector(a, mask1) * shufflevector(b, mask2) - shufflevector(a, mask2) * shufflevector(b, mask1);
+  }
+  return _result;
+}
+
 void Dot::Operation::operator()(SHVar &output, const SHVar &input, const SHVar &operand) {
   if (operand.valueType != input.valueType)
     throw ActivationError("LinAlg.Dot works only with same input and operand types.");
@@ -65,6 +84,46 @@ SHVar Dot::activate(SHContext *context, const SHVar &input) {
   return doActivate(context, input, op);
 }
 
+SHVar Dot::activateArray(SHContext *context, const SHVar &input) {
+  auto &operand = _operand.get();
+  const auto len = arrayPairs(input, operand);
+  const auto &src = input.payload.arrayValue;
+  auto &dst = arrayOutput(_result, Float, len);
+  withVectorPayload(input.innerType, [&](auto p) {
+    using P = decltype(p);
+    for (uint32_t i = 0; i < len; i++) {
+      dst.elements[i].floatValue = P::dot(P::get(src.elements[i]), P::get(arrayOperand(operand, i)));
+    }
+  });
+  return _result;
+}
+
+SHVar LengthSquared::activateArray(SHContext *context, const SHVar &input) {
+  const auto &src = input.payload.arrayValue;
+  auto &dst = arrayOutput(_result, Float, src.len);
+  withVectorPayload(input.innerType, [&](auto p) {
+    using P = decltype(p);
+    for (uint32_t i = 0; i < src.len; i++) {
+      const auto &v = P::get(src.elements[i]);
+      dst.elements[i].floatValue = P::dot(v, v);
+    }
+  });
+  return _result;
+}
+
+SHVar Length::activateArray(SHContext *context, const SHVar &input) {
+  const auto &src = input.payload.arrayValue;
+  auto &dst = arrayOutput(_result, Float, src.len);
+  withVectorPayload(input.innerType, [&](auto p) {
+    using P = decltype(p);
+    for (uint32_t i = 0; i < src.len; i++) {
+      const auto &v = P::get(src.elements[i]);
+      dst.elements[i].floatValue = __builtin_sqrt(P::dot(v, v));
+    }
+  });
+  return _result;
+}
+
 void Normalize::Operation::operator()(SHVar &output, const SHVar &input) {
   SHVar len{};
   lenOp(len, input);
@@ -148,6 +207,77 @@ SHVar Normalize::activateFloatSeq(SHContext *context, const SHVar &input) {
   }
 }
 
+SHVar Normalize::activateArray(SHContext *context, const SHVar &input) {
+  const auto &src = input.payload.arrayValue;
+  auto &dst = arrayOutput(_result, input.innerType, src.len);
+  withVectorPayload(input.innerType, [&](auto p) {
+    using P = decltype(p);
+    using E = typename P::Element;
+    for (uint32_t i = 0; i < src.len; i++) {
+      const auto &v = P::get(src.elements[i]);
+      auto &out = P::get(dst.elements[i]);
+      const auto len = E(__builtin_sqrt(P::dot(v, v)));
+      if (len > 0 || !_positiveOnly) {
+        out = v / len;
+        if (_positiveOnly) {
+          out = (out + E(1)) / E(2);
+        }
+      } else {
+        out = v;
+      }
+    }
+  });
+  return _result;
+}
+
+SHVar MatMul::activateArray(SHContext *context, const SHVar &input) {
+  // column major like linalg::mul, each vector weights the columns of the matrix
+  auto &operand = _operand.get();
+  const auto &mat = input.payload.seqValue;
+  const auto &src = operand.payload.arrayValue;
+  const auto columns = mat.len > 0 ? mat.elements[0].valueType : SHType::None;
+  auto &dst = arrayOutput(_result, operand.innerType, src.len);
+  if (operand.innerType == Float2 && columns == Float2 && mat.len == 2) {
+    const auto c0 = mat.elements[0].payload.float2Value;
+    const auto c1 = mat.elements[1].payload.float2Value;
+    for (uint32_t i = 0; i < src.len; i++) {
+      const auto v = src.elements[i].float2Value;
+      dst.elements[i].float2Value = c0 * v[0] + c1 * v[1];
+    }
+  } else if (operand.innerType == Float3 && columns == Float3 && mat.len == 3) {
+    const auto c0 = mat.elements[0].payload.float3Value;
+    const auto c1 = mat.elements[1].payload.float3Value;
+    const auto c2 = mat.elements[2].payload.float3Value;
+    for (uint32_t i = 0; i < src.len; i++) {
+      const auto v = src.elements[i].float3Value;
+      dst.elements[i].float3Value = c0 * v[0] + c1 * v[1] + c2 * v[2];
+    }
+  } else if (operand.innerType == Float4 && columns == Float4 && mat.len == 4) {
+    const auto c0 = mat.elements[0].payload.float4Value;
+    const auto c1 = mat.elements[1].payload.float4Value;
+    const auto c2 = mat.elements[2].payload.float4Value;
+    const auto c3 = mat.elements[3].payload.float4Value;
+    for (uint32_t i = 0; i < src.len; i++) {
+      const auto v = src.elements[i].float4Value;
+      dst.elements[i].float4Value = c0 * v[0] + c1 * v[1] + c2 * v[2] + c3 * v[3];
+    }
+  } else if (operand.innerType == Float3 && columns == Float4 && mat.len == 4) {
+    // points, w is 1 so the translation column is just added
+    const SHFloat4 mask = {1, 1, 1, 0};
+    const auto c0 = mat.elements[0].payload.float4Value * mask;
+    const auto c1 = mat.elements[1].payload.float4Value * mask;
+    const auto c2 = mat.elements[2].payload.float4Value * mask;
+    const auto c3 = mat.elements[3].payload.float4Value * mask;
+    for (uint32_t i = 0; i < src.len; i++) {
+      const auto v = src.elements[i].float3Value;
+      dst.elements[i].float3Value = c0 * v[0] + c1 * v[1] + c2 * v[2] + c3;
+    }
+  } else {
+    throw ActivationError("MatMul expects a 2x2, 3x3 or 4x4 matrix matching the vectors of the array.");
+  }
+  return _result;
+}
+
 SHVar MatMul::activate(SHContext *context, const SHVar &input) {
   auto &operand = _operand.get();
   // expect SeqSeq as in 2x 2D arrays or Seq1 Mat @ Vec
@@ -7,21 +7,78 @@
 namespace shards {
 namespace Math {
 namespace LinAlg {
+// lanes of vector payloads, used by the kernels transforming whole arrays of vectors
+template <SHType T> struct VectorPayload;
+
+template <> struct VectorPayload<SHType::Float2> {
+  using Element = double;
+  static SHFloat2 &get(SHVarPayload &p) { return p.float2Value; }
+  static const SHFloat2 &get(const SHVarPayload &p) { return p.float2Value; }
+  static double dot(const SHFloat2 &a, const SHFloat2 &b) { return a[0] * b[0] + a[1] * b[1]; }
+};
+
+template <> struct VectorPayload<SHType::Float3> {
+  using Element = float;
+  static SHFloat3 &get(SHVarPayload &p) { return p.float3Value; }
+  static const SHFloat3 &get(const SHVarPayload &p) { return p.float3Value; }
+  static double dot(const SHFloat3 &a, const SHFloat3 &b) {
+    const SHFloat3 m = a * b;
+    return double(m[0]) + m[1] + m[2];
+  }
+};
+
+template <> struct VectorPayload<SHType::Float4> {
+  using Element = float;
+  static SHFloat4 &get(SHVarPayload &p) { return p.float4Value; }
+  static const SHFloat4 &get(const SHVarPayload &p) { return p.float4Value; }
+  static double dot(const SHFloat4 &a, const SHFloat4 &b) {
+    const SHFloat4 m = a * b;
+    return double(m[0]) + m[1] + m[2] + m[3];
+  }
+};
+
+// calls f with the VectorPayload matching the inner type of an array
+template <typename F> void withVectorPayload(SHType type, F &&f) {
+  switch (type) {
+  case SHType::Float2:
+    f(VectorPayload<SHType::Float2>{});
+    break;
+  case SHType::Float3:
+    f(VectorPayload<SHType::Float3>{});
+    break;
+  case SHType::Float4:
+    f(VectorPayload<SHType::Float4>{});
+    break;
+  default:
+    throw ActivationError(fmt::format("Expected an array of Float2, Float3 or Float4, got {}", type2Name(type)));
+  }
+}
+
+// resizes output into an array of len elements, reusing its memory
+inline SHPayloadArray &arrayOutput(SHVar &output, SHType innerType, uint32_t len) {
+  if (output.valueType != SHType::Array) {
+    destroyVar(output);
+    output.valueType = SHType::Array;
+  }
+  output.innerType = innerType;
+  shards::arrayResize(output.payload.arrayValue, len);
+  return output.payload.arrayValue;
+}
+
 struct VectorUnaryBase : public UnaryBase {
-  static SHTypesInfo inputTypes() { return CoreInfo::FloatVectors; }
+  static SHTypesInfo inputTypes() { return CoreInfo::FloatVectorsOrArrays; }
 
-  static SHTypesInfo outputTypes() { return CoreInfo::FloatVectors; }
+  static SHTypesInfo outputTypes() { return CoreInfo::FloatVectorsOrArrays; }
 
   SHTypeInfo compose(const SHInstanceData &data) { return data.inputType; }
 
   template <class Operation> SHVar doActivate(SHContext *context, const SHVar &input, Operation operate) {
     if (input.valueType == Seq) {
+      const auto len = input.payload.seqValue.len;
       _result.valueType = Seq;
-      shards::arrayResize(_result.payload.seqValue, 0);
-      for (uint32_t i = 0; i < input.payload.seqValue.len; i++) {
-        SHVar scratch;
-        operate(scratch, input);
-        shards::arrayPush(_result.payload.seqValue, scratch);
+      shards::arrayResize(_result.payload.seqValue, len);
+      for (uint32_t i = 0; i < len; i++) {
+        operate(_result.payload.seqValue.elements[i], input.payload.seqValue.elements[i]);
       }
       return _result;
     } else {
@@ -33,15 +90,46 @@ struct VectorUnaryBase : public UnaryBase {
 };
 
 struct VectorBinaryBase : public BinaryBase {
-  static SHTypesInfo inputTypes() { return CoreInfo::FloatVectors; }
+  static SHTypesInfo inputTypes() { return CoreInfo::FloatVectorsOrArrays; }
 
-  static SHTypesInfo outputTypes() { return CoreInfo::FloatVectors; }
+  static SHTypesInfo outputTypes() { return CoreInfo::FloatVectorsOrArrays; }
 
   static inline ParamsInfo paramsInfo =
-      ParamsInfo(ParamsInfo::Param("Operand", SHCCSTR("The operand."), CoreInfo::FloatVectorsOrVar));
+      ParamsInfo(ParamsInfo::Param("Operand", SHCCSTR("The operand."), CoreInfo::FloatVectorsOrArraysOrVar));
 
   static SHParametersInfo parameters() { return SHParametersInfo(paramsInfo); }
 
+  // type of the operand, variables are looked up in the shared ones
+  SHTypeInfo operandType(const SHInstanceData &data) {
+    SHVar operandSpec = _operand;
+    if (operandSpec.valueType == ContextVar) {
+      for (uint32_t i = 0; i < data.shared.len; i++) {
+        if (strcmp(data.shared.elements[i].name, operandSpec.payload.stringValue) == 0)
+          return data.shared.elements[i].exposedType;
+      }
+      throw ComposeError("Math operand variable not found: " + std::string(operandSpec.payload.stringValue));
+    }
+    SHTypeInfo info{operandSpec.valueType};
+    info.innerType = operandSpec.innerType;
+    return info;
+  }
+
+  // pairs made by an input array with its operand, either a single vector or an array
+  uint32_t arrayPairs(const SHVar &input, const SHVar &operand) {
+    if (_opType == ArrayArray) {
+      if (operand.innerType != input.innerType)
+        throw ActivationError("Expected input and operand arrays of the same vector type.");
+      return std::min(input.payload.arrayValue.len, operand.payload.arrayValue.len);
+    }
+    if (operand.valueType != input.innerType)
+      throw ActivationError("Expected an operand of the same vector type of the input array.");
+    return input.payload.arrayValue.len;
+  }
+
+  const SHVarPayload &arrayOperand(const SHVar &operand, uint32_t i) const {
+    return _opType == ArrayArray ? operand.payload.arrayValue.elements[i] : operand.payload;
+  }
+
   template <class Operation> SHVar doActivate(SHContext *context, const SHVar &input, Operation operate) {
     auto &operand = _operand.get();
     if (_opType == Normal) {
@@ -49,21 +137,19 @@ struct VectorBinaryBase : public BinaryBase {
       operate(scratch, input, operand);
       return scratch;
     } else if (_opType == Seq1) {
+      const auto len = input.payload.seqValue.len;
       _result.valueType = Seq;
-      shards::arrayResize(_result.payload.seqValue, 0);
-      for (uint32_t i = 0; i < input.payload.seqValue.len; i++) {
-        SHVar scratch;
-        operate(scratch, input.payload.seqValue.elements[i], operand);
-        shards::arrayPush(_result.payload.seqValue, scratch);
+      shards::arrayResize(_result.payload.seqValue, len);
+      for (uint32_t i = 0; i < len; i++) {
+        operate(_result.payload.seqValue.elements[i], input.payload.seqValue.elements[i], operand);
       }
       return _result;
     } else {
+      const auto len = std::min(input.payload.seqValue.len, operand.payload.seqValue.len);
       _result.valueType = Seq;
-      shards::arrayResize(_result.payload.seqValue, 0);
-      for (uint32_t i = 0; i < input.payload.seqValue.len && i < operand.payload.seqValue.len; i++) {
-        SHVar scratch;
-        operate(scratch, input.payload.seqValue.elements[i], operand.payload.seqValue.elements[i]);
-        shards::arrayPush(_result.payload.seqValue, scratch);
+      shards::arrayResize(_result.payload.seqValue, len);
+      for (uint32_t i = 0; i < len; i++) {
+        operate(_result.payload.seqValue.elements[i], input.payload.seqValue.elements[i], operand.payload.seqValue.elements[i]);
       }
       return _result;
     }
@@ -71,18 +157,37 @@ struct VectorBinaryBase : public BinaryBase {
 };
 
 struct Cross : public VectorBinaryBase {
+  SHTypeInfo compose(const SHInstanceData &data) {
+    auto resultType = VectorBinaryBase::compose(data);
+    if (data.inputType.basicType == SHType::Array) {
+      OVERRIDE_ACTIVATE(data, activateArray);
+    } else {
+      OVERRIDE_ACTIVATE(data, activate);
+    }
+    return resultType;
+  }
+
   struct Operation {
     void operator()(SHVar &output, const SHVar &input, const SHVar &operand);
   };
 
   SHVar activate(SHContext *context, const SHVar &input);
+  SHVar activateArray(SHContext *context, const SHVar &input);
 };
 
+// scalar results, packed in an array when the input is an array of vectors
+static inline Types FloatOrFloatArray{{CoreInfo::FloatType, CoreInfo::FloatArrayType}};
+
 struct Dot : public VectorBinaryBase {
-  static SHTypesInfo outputTypes() { return CoreInfo::FloatType; }
+  static SHTypesInfo outputTypes() { return FloatOrFloatArray; }
 
   SHTypeInfo compose(const SHInstanceData &data) {
     VectorBinaryBase::compose(data);
+    if (data.inputType.basicType == SHType::Array) {
+      OVERRIDE_ACTIVATE(data, activateArray);
+      return CoreInfo::FloatArrayType;
+    }
+    OVERRIDE_ACTIVATE(data, activate);
     return CoreInfo::FloatType;
   }
 
@@ -91,13 +196,18 @@ struct Dot : public VectorBinaryBase {
   };
 
   SHVar activate(SHContext *context, const SHVar &input);
+  SHVar activateArray(SHContext *context, const SHVar &input);
 };
 
 struct LengthSquared : public VectorUnaryBase {
-  static SHTypesInfo outputTypes() { return CoreInfo::FloatType; }
+  static SHTypesInfo outputTypes() { return FloatOrFloatArray; }
 
   SHTypeInfo compose(const SHInstanceData &data) {
-    VectorUnaryBase::compose(data);
+    if (data.inputType.basicType == SHType::Array) {
+      OVERRIDE_ACTIVATE(data, activateArray);
+      return CoreInfo::FloatArrayType;
+    }
+    OVERRIDE_ACTIVATE(data, activate);
     return CoreInfo::FloatType;
   }
 
@@ -109,13 +219,18 @@ struct LengthSquared : public VectorUnaryBase {
     const Operation op;
     return doActivate(context, input, op);
   }
+  SHVar activateArray(SHContext *context, const SHVar &input);
 };
 
 struct Length : public VectorUnaryBase {
-  static SHTypesInfo outputTypes() { return CoreInfo::FloatType; }
+  static SHTypesInfo outputTypes() { return FloatOrFloatArray; }
 
   SHTypeInfo compose(const SHInstanceData &data) {
-    VectorUnaryBase::compose(data);
+    if (data.inputType.basicType == SHType::Array) {
+      OVERRIDE_ACTIVATE(data, activateArray);
+      return CoreInfo::FloatArrayType;
+    }
+    OVERRIDE_ACTIVATE(data, activate);
     return CoreInfo::FloatType;
   }
 
@@ -130,6 +245,7 @@ struct Length : public VectorUnaryBase {
     const Operation op;
     return doActivate(context, input, op);
   }
+  SHVar activateArray(SHContext *context, const SHVar &input);
 };
 
 struct Normalize : public VectorUnaryBase {
@@ -137,12 +253,14 @@ struct Normalize : public VectorUnaryBase {
   bool _positiveOnly{false};
 
   // Normalize also supports Float seqs
-  static SHTypesInfo inputTypes() { return CoreInfo::FloatVectorsOrFloatSeq; }
-  static SHTypesInfo outputTypes() { return CoreInfo::FloatVectorsOrFloatSeq; }
+  static SHTypesInfo inputTypes() { return CoreInfo::FloatVectorsOrFloatSeqOrArrays; }
+  static SHTypesInfo outputTypes() { return CoreInfo::FloatVectorsOrFloatSeqOrArrays; }
 
   SHTypeInfo compose(const SHInstanceData &data) {
-    if (data.inputType.basicType == Seq && data.inputType.seqTypes.len == 1 &&
-        data.inputType.seqTypes.elements[0].basicType == Float) {
+    if (data.inputType.basicType == SHType::Array) {
+      OVERRIDE_ACTIVATE(data, activateArray);
+    } else if (data.inputType.basicType == Seq && data.inputType.seqTypes.len == 1 &&
+               data.inputType.seqTypes.elements[0].basicType == Float) {
       OVERRIDE_ACTIVATE(data, activateFloatSeq);
     } else {
       OVERRIDE_ACTIVATE(data, activate);
@@ -168,15 +286,32 @@ struct Normalize : public VectorUnaryBase {
 
   SHVar activate(SHContext *context, const SHVar &input);
   SHVar activateFloatSeq(SHContext *context, const SHVar &input);
+  SHVar activateArray(SHContext *context, const SHVar &input);
 };
 
 struct MatMul : public VectorBinaryBase {
   // MatMul is special...
   // Mat @ Mat = Mat
   // Mat @ Vec = Vec
+  // Mat @ Array of Vecs = Array of Vecs, a 4x4 matrix transforms Float3 as points
   // If ever becomes a bottle neck, valgrind and optimize
 
   SHTypeInfo compose(const SHInstanceData &data) {
+    const auto operand = operandType(data);
+    if (operand.basicType == SHType::Array) {
+      if (data.inputType.basicType != Seq || data.inputType.seqTypes.len != 1) {
+        throw ComposeError("MatMul expected a matrix (Seq of FloatX) as input to transform an array.");
+      }
+      const auto columns = data.inputType.seqTypes.elements[0].basicType;
+      if (operand.innerType != columns && !(columns == Float4 && operand.innerType == Float3)) {
+        throw ComposeError(fmt::format("MatMul cannot transform an array of {} with a matrix of {}",
+                                       type2Name(operand.innerType), type2Name(columns)));
+      }
+      OVERRIDE_ACTIVATE(data, activateArray);
+      return Type::ArrayOf(operand.innerType);
+    }
+    OVERRIDE_ACTIVATE(data, activate);
+
     BinaryBase::compose(data);
     if (_opType == SeqSeq) {
       return data.inputType;
@@ -189,6 +324,7 @@ struct MatMul : public VectorBinaryBase {
   }
 
   SHVar activate(SHContext *context, const SHVar &input);
+  SHVar activateArray(SHContext *context, const SHVar &input);
 };
 
 struct Transpose : public VectorUnaryBase {
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright © 2021 Fragcolor Pte. Ltd. */
+
+#ifndef SH_CORE_SHARDS_MAPPED_FILE
+#define SH_CORE_SHARDS_MAPPED_FILE
+
+#include "shared.hpp"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/filesystem.hpp>
+
+namespace shards {
+// Read only mapping of a whole file, pages are loaded lazily by the OS.
+// Shared so that views into it can outlive the shard that opened it, see BorrowingReader.
+struct MappedFile {
+  MappedFile(const std::string &path) {
+    _size = size_t(boost::filesystem::file_size(path));
+    // empty files cannot be mapped
+    if (_size > 0) {
+      _mapping = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+      _region = boost::interprocess::mapped_region(_mapping, boost::interprocess::read_only, 0, _size);
+    }
+  }
+
+  static std::shared_ptr<MappedFile> open(const std::string &path) {
+    try {
+      return std::make_shared<MappedFile>(path);
+    } catch (const std::exception &e) {
+      SHLOG_ERROR("Failed to map file: {}, error: {}", path, e.what());
+      throw ActivationError("Failed to map file");
+    }
+  }
+
+  const uint8_t *data() const { return _size > 0 ? reinterpret_cast<const uint8_t *>(_region.get_address()) : nullptr; }
+  size_t size() const { return _size; }
+
+  // the OS zero fills the rest of the last page, so unless the file ends on a page
+  // boundary the mapping can be used as a null terminated string without copies
+  bool nullTerminated() const { return _size > 0 && _size % boost::interprocess::mapped_region::get_page_size() != 0; }
+
+private:
+  size_t _size{0};
+  boost::interprocess::file_mapping _mapping;
+  boost::interprocess::mapped_region _region;
+};
+} // namespace shards
+
+#endif
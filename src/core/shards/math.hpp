@@ -9,6 +9,8 @@
 #include "shards.h"
 #include "shards.hpp"
 #include "core.hpp"
+#include "math_simd.hpp"
+#include <functional>
 #include <sstream>
 #include <stdexcept>
 #include <variant>
@@ -19,10 +21,16 @@
 
 namespace shards {
 namespace Math {
+// splits [0, len) in chunks run on the shared thread pool and waits for them,
+// the calling thread takes chunks too so it never just sits idle,
+// chunks are at least minChunk long as smaller ones cost more in scheduling than they save
+void parallelFor(size_t len, const std::function<void(size_t, size_t)> &f, size_t minChunk = 4096);
+
 struct Base {
   static inline Types MathTypes{{CoreInfo::IntType, CoreInfo::Int2Type, CoreInfo::Int3Type, CoreInfo::Int4Type,
                                  CoreInfo::Int8Type, CoreInfo::Int16Type, CoreInfo::FloatType, CoreInfo::Float2Type,
-                                 CoreInfo::Float3Type, CoreInfo::Float4Type, CoreInfo::ColorType, CoreInfo::AnySeqType}};
+                                 CoreInfo::Float3Type, CoreInfo::Float4Type, CoreInfo::ColorType, CoreInfo::AnySeqType,
+                                 CoreInfo::AnyArrayType}};
 
   SHVar _result{};
 
@@ -43,8 +51,8 @@ struct Base {
 };
 
 struct UnaryBase : public Base {
-  static inline Types FloatOrSeqTypes{
-      {CoreInfo::FloatType, CoreInfo::Float2Type, CoreInfo::Float3Type, CoreInfo::Float4Type, CoreInfo::AnySeqType}};
+  static inline Types FloatOrSeqTypes{{CoreInfo::FloatType, CoreInfo::Float2Type, CoreInfo::Float3Type, CoreInfo::Float4Type,
+                                       CoreInfo::AnySeqType, CoreInfo::AnyArrayType}};
 
   static SHTypesInfo inputTypes() { return FloatOrSeqTypes; }
   static SHOptionalString inputHelp() {
@@ -54,14 +62,15 @@ struct UnaryBase : public Base {
 };
 
 struct BinaryBase : public Base {
-  enum OpType { Invalid, Broadcast, Normal, Seq1, SeqSeq };
+  enum OpType { Invalid, Broadcast, Normal, Seq1, SeqSeq, Array1, ArrayArray };
 
   static inline Types MathTypesOrVar{
       {CoreInfo::IntType,       CoreInfo::IntVarType,   CoreInfo::Int2Type,      CoreInfo::Int2VarType,  CoreInfo::Int3Type,
        CoreInfo::Int3VarType,   CoreInfo::Int4Type,     CoreInfo::Int4VarType,   CoreInfo::Int8Type,     CoreInfo::Int8VarType,
        CoreInfo::Int16Type,     CoreInfo::Int16VarType, CoreInfo::FloatType,     CoreInfo::FloatVarType, CoreInfo::Float2Type,
        CoreInfo::Float2VarType, CoreInfo::Float3Type,   CoreInfo::Float3VarType, CoreInfo::Float4Type,   CoreInfo::Float4VarType,
-       CoreInfo::ColorType,     CoreInfo::ColorVarType, CoreInfo::AnySeqType,    CoreInfo::AnyVarSeqType}};
+       CoreInfo::ColorType,     CoreInfo::ColorVarType, CoreInfo::AnySeqType,    CoreInfo::AnyVarSeqType, CoreInfo::AnyArrayType,
+       CoreInfo::AnyVarArrayType}};
 
   static inline ParamsInfo mathParamsInfo =
       ParamsInfo(ParamsInfo::Param("Operand", SHCCSTR("The operand for this operation."), MathTypesOrVar));
@@ -86,8 +95,23 @@ struct BinaryBase : public Base {
     return ComposeError(errStream.str());
   }
 
-  void validateTypes(const SHTypeInfo &lhs, const SHType &rhs, SHTypeInfo &resultType) {
-    if (rhs != Seq && lhs.basicType != Seq) {
+  // rhsInner is the element type of an Array operand, None when unknown until activation
+  void validateTypes(const SHTypeInfo &lhs, const SHType &rhs, SHType rhsInner, SHTypeInfo &resultType) {
+    if (lhs.basicType == SHType::Array || rhs == SHType::Array) {
+      // arrays only operate with arrays or with single values of their element type,
+      // element types unknown here are checked when operating
+      if (lhs.basicType == SHType::Array && rhs == SHType::Array) {
+        if (lhs.innerType != SHType::None && rhsInner != SHType::None && lhs.innerType != rhsInner)
+          throw formatTypeError(lhs.innerType, rhsInner);
+        _opType = ArrayArray;
+      } else if (lhs.basicType == SHType::Array && rhs != Seq && (lhs.innerType == SHType::None || lhs.innerType == rhs)) {
+        _opType = Array1;
+      } else if (lhs.basicType == SHType::Array) {
+        throw formatTypeError(lhs.innerType, rhs);
+      } else {
+        throw formatTypeError(lhs.basicType, rhs);
+      }
+    } else if (rhs != Seq && lhs.basicType != Seq) {
       _lhsVecType = VectorTypeLookup::getInstance().get(lhs.basicType);
       _rhsVecType = VectorTypeLookup::getInstance().get(rhs);
       if (_lhsVecType || _rhsVecType) {
@@ -131,12 +155,14 @@ struct BinaryBase : public Base {
       for (uint32_t i = 0; i < data.shared.len; i++) {
         // normal variable
         if (strcmp(data.shared.elements[i].name, operandSpec.payload.stringValue) == 0) {
-          validateTypes(data.inputType, data.shared.elements[i].exposedType.basicType, resultType);
+          const auto &exposedType = data.shared.elements[i].exposedType;
+          validateTypes(data.inputType, exposedType.basicType, exposedType.innerType, resultType);
           break;
         }
       }
     } else {
-      validateTypes(data.inputType, operandSpec.valueType, resultType);
+      validateTypes(data.inputType, operandSpec.valueType,
+                    operandSpec.valueType == SHType::Array ? operandSpec.innerType : SHType::None, resultType);
     }
 
     if (_opType == Invalid) {
@@ -163,12 +189,56 @@ struct BinaryBase : public Base {
 
 template <class OP> struct BinaryOperation : public BinaryBase {
   SH_HAS_MEMBER_TEST(hasApply);
+  SH_HAS_MEMBER_TEST(simdOp);
+
+  // element type of seqs handled by a Simd kernel, None when not applicable
+  SHType _laneType{SHType::None};
+  int64_t _parallel{0};
 
   static SHOptionalString help() {
     return SHCCSTR("Applies the binary operation on the input value and the operand and returns the result (or a sequence of "
                    "results if the input and the operand are sequences).");
   }
 
+  static inline ParamsInfo paramsInfo = ParamsInfo(
+      ParamsInfo::Param("Operand", SHCCSTR("The operand for this operation."), MathTypesOrVar),
+      ParamsInfo::Param("Parallel",
+                        SHCCSTR("Sequences and arrays at least this long are split across the shared thread pool, 0 "
+                                "never splits."),
+                        CoreInfo::IntType));
+
+  // only ops with a Simd kernel can split their work, the others don't expose Parallel
+  static SHParametersInfo parameters() {
+    if constexpr (has_simdOp<OP>::value)
+      return SHParametersInfo(paramsInfo);
+    else
+      return SHParametersInfo(mathParamsInfo);
+  }
+
+  void setParam(int index, const SHVar &value) {
+    switch (index) {
+    case 0:
+      _operand = value;
+      break;
+    case 1:
+      _parallel = value.payload.intValue;
+      break;
+    default:
+      break;
+    }
+  }
+
+  SHVar getParam(int index) {
+    switch (index) {
+    case 0:
+      return _operand;
+    case 1:
+      return Var(_parallel);
+    default:
+      return Var::Empty;
+    }
+  }
+
   SHTypeInfo compose(const SHInstanceData &data) {
     SHTypeInfo resultType = BinaryBase::compose(data);
     if (_opType == Broadcast) {
@@ -176,9 +246,74 @@ template <class OP> struct BinaryOperation : public BinaryBase {
         throw ComposeError("Operator broadcast not supported for this type");
       }
     }
+
+    _laneType = SHType::None;
+    if constexpr (has_simdOp<OP>::value) {
+      if ((_opType == Seq1 || _opType == SeqSeq) && data.inputType.seqTypes.len == 1) {
+        const auto type = data.inputType.seqTypes.elements[0].basicType;
+        if (Simd::supported(OP::simdOp, Simd::laneOf(type)) && (_opType == Seq1 || operandIsSeqOf(data, type)))
+          _laneType = type;
+      }
+    }
     return resultType;
   }
 
+  // SeqSeq compose is loose, kernels need to know the operand elements too
+  bool operandIsSeqOf(const SHInstanceData &data, SHType type) {
+    SHVar operandSpec = _operand;
+    if (operandSpec.valueType == ContextVar) {
+      for (uint32_t i = 0; i < data.shared.len; i++) {
+        const auto &share = data.shared.elements[i];
+        if (strcmp(share.name, operandSpec.payload.stringValue) == 0) {
+          const auto &t = share.exposedType;
+          return t.basicType == Seq && t.seqTypes.len == 1 && t.seqTypes.elements[0].basicType == type;
+        }
+      }
+      return false;
+    }
+    for (uint32_t i = 0; i < operandSpec.payload.seqValue.len; i++) {
+      if (operandSpec.payload.seqValue.elements[i].valueType != type)
+        return false;
+    }
+    return true;
+  }
+
+  // runs the kernel on len elements, a non broadcast operand of blen elements wraps around
+  void runKernel(Simd::Lane lane, Simd::Operands ops, size_t len, size_t blen) {
+    if constexpr (has_simdOp<OP>::value) {
+      if (blen == 1)
+        ops.bStride = 0;
+      auto range = [&](size_t start, size_t end) {
+        for (size_t i = start; i < end;) {
+          const size_t bi = ops.bStride ? i % blen : 0;
+          const size_t n = ops.bStride ? std::min(end - i, blen - bi) : end - i;
+          auto chunk = ops.offset(i);
+          chunk.b = ops.b + bi * ops.bStride;
+          Simd::run<OP::simdOp>(lane, chunk, n);
+          i += n;
+        }
+      };
+      if (_parallel > 0 && len >= size_t(_parallel))
+        parallelFor(len, range);
+      else
+        range(0, len);
+    }
+  }
+
+  // homogeneous seqs, element headers are written and payloads go through the kernel
+  void operateSeqLane(SHVar &output, const SHVar &a, const SHVar *b, size_t blen, size_t bStride) {
+    const auto len = a.payload.seqValue.len;
+    auto &out = output.payload.seqValue;
+    for (uint32_t i = 0; i < len; i++) {
+      out.elements[i].valueType = _laneType;
+    }
+    runKernel(Simd::laneOf(_laneType),
+              {reinterpret_cast<uint8_t *>(out.elements), sizeof(SHVar),
+               reinterpret_cast<const uint8_t *>(a.payload.seqValue.elements), sizeof(SHVar),
+               reinterpret_cast<const uint8_t *>(b), bStride},
+              len, blen);
+  }
+
   void operate(OpType opType, SHVar &output, const SHVar &a, const SHVar &b) {
     if (opType == Broadcast) {
       // This implements broadcast operators on float types
@@ -234,10 +369,14 @@ template <class OP> struct BinaryOperation : public BinaryBase {
         destroyVar(output);
         output.valueType = Seq;
       }
-      // TODO auto-parallelize with taskflow (should be optional)
       auto olen = b.payload.seqValue.len;
-      shards::arrayResize(output.payload.seqValue, 0);
-      for (uint32_t i = 0; i < a.payload.seqValue.len && olen > 0; i++) {
+      const auto len = olen > 0 ? a.payload.seqValue.len : 0;
+      shards::arrayResize(output.payload.seqValue, len);
+      if (_laneType != SHType::None) {
+        operateSeqLane(output, a, b.payload.seqValue.elements, olen, sizeof(SHVar));
+        return;
+      }
+      for (uint32_t i = 0; i < len; i++) {
         const auto &sa = a.payload.seqValue.elements[i];
         const auto &sb = b.payload.seqValue.elements[i % olen];
         auto type = Normal;
@@ -246,10 +385,10 @@ template <class OP> struct BinaryOperation : public BinaryBase {
         } else if (sa.valueType == Seq && sb.valueType != Seq) {
           type = Seq1;
         }
-        const auto len = output.payload.seqValue.len;
-        shards::arrayResize(output.payload.seqValue, len + 1);
-        operate(type, output.payload.seqValue.elements[len], sa, sb);
+        operate(type, output.payload.seqValue.elements[i], sa, sb);
       }
+    } else if (opType == Array1 || opType == ArrayArray) {
+      operateArray(opType, output, a, b);
     } else {
       if (opType == Normal && output.valueType == Seq) {
         // something changed, avoid leaking
@@ -263,6 +402,52 @@ template <class OP> struct BinaryOperation : public BinaryBase {
     }
   }
 
+  // arrays are operated payload by payload, like seqs the operand array wraps around
+  void operateArray(OpType opType, SHVar &output, const SHVar &a, const SHVar &b) {
+    if (output.valueType != SHType::Array) {
+      destroyVar(output);
+      output.valueType = SHType::Array;
+    }
+    output.innerType = a.innerType;
+
+    const auto &input = a.payload.arrayValue;
+    const auto olen = opType == ArrayArray ? b.payload.arrayValue.len : 1;
+    if (opType == ArrayArray && a.innerType != b.innerType) {
+      throw ActivationError(fmt::format("Operation not supported between arrays of {} and {}", type2Name(a.innerType),
+                                        type2Name(b.innerType)));
+    }
+    const auto len = olen > 0 ? input.len : 0;
+    shards::arrayResize(output.payload.arrayValue, len);
+
+    if constexpr (has_simdOp<OP>::value) {
+      const auto lane = Simd::laneOf(a.innerType);
+      if (Simd::supported(OP::simdOp, lane) && (opType == ArrayArray || b.valueType == a.innerType)) {
+        const auto b0 = opType == ArrayArray ? reinterpret_cast<const uint8_t *>(b.payload.arrayValue.elements)
+                                             : reinterpret_cast<const uint8_t *>(&b.payload);
+        runKernel(lane,
+                  {reinterpret_cast<uint8_t *>(output.payload.arrayValue.elements), sizeof(SHVarPayload),
+                   reinterpret_cast<const uint8_t *>(input.elements), sizeof(SHVarPayload), b0,
+                   opType == ArrayArray ? sizeof(SHVarPayload) : 0},
+                  len, olen);
+        return;
+      }
+    }
+
+    OP op;
+    SHVar lhs{};
+    lhs.valueType = a.innerType;
+    SHVar rhs = b;
+    rhs.valueType = opType == ArrayArray ? b.innerType : b.valueType;
+    SHVar scratch{};
+    for (uint32_t i = 0; i < len; i++) {
+      lhs.payload = input.elements[i];
+      if (opType == ArrayArray)
+        rhs.payload = b.payload.arrayValue.elements[i % olen];
+      op(scratch, lhs, rhs, this);
+      output.payload.arrayValue.elements[i] = scratch.payload;
+    }
+  }
+
   ALWAYS_INLINE void operateFast(OpType opType, SHVar &output, const SHVar &a, const SHVar &b) {
     OP op;
     if (likely(opType == Normal)) {
@@ -272,12 +457,14 @@ template <class OP> struct BinaryOperation : public BinaryBase {
         destroyVar(output);
         output.valueType = Seq;
       }
-      shards::arrayResize(output.payload.seqValue, 0);
-      for (uint32_t i = 0; i < a.payload.seqValue.len; i++) {
-        // notice, we use scratch _output here
-        SHVar scratch;
-        op(scratch, a.payload.seqValue.elements[i], b, this);
-        shards::arrayPush(output.payload.seqValue, scratch);
+      const auto len = a.payload.seqValue.len;
+      shards::arrayResize(output.payload.seqValue, len);
+      if (_laneType != SHType::None) {
+        operateSeqLane(output, a, &b, 1, 0);
+        return;
+      }
+      for (uint32_t i = 0; i < len; i++) {
+        op(output.payload.seqValue.elements[i], a.payload.seqValue.elements[i], b, this);
       }
     } else {
       operate(opType, output, a, b);
@@ -307,6 +494,7 @@ template <class OP> struct BinaryIntOperation : public BinaryOperation<OP> {
 #define MATH_BINARY_OPERATION(NAME, OPERATOR, DIV_BY_ZERO)                                              \
   struct NAME##Op final {                                                                               \
     static constexpr bool hasApply{};                                                                   \
+    static constexpr Simd::Op simdOp{Simd::Op::NAME};                                                   \
     template <typename T> T apply(const T &lhs, const T &rhs) { return lhs OPERATOR rhs; }              \
     ALWAYS_INLINE void operator()(SHVar &output, const SHVar &input, const SHVar &operand, void *) {    \
       switch (input.valueType) {                                                                        \
@@ -501,6 +689,9 @@ template <SHType SHT, typename FuncD, typename FuncF> struct UnaryOperation {
       if (data.inputType.basicType == SHType::Seq) {                                             \
         OVERRIDE_ACTIVATE(data, activateSeq);                                                    \
         static_cast<Shard *>(data.shard)->inlineShardId = NotInline;                             \
+      } else if (data.inputType.basicType == SHType::Array) {                                    \
+        OVERRIDE_ACTIVATE(data, activateArray);                                                  \
+        static_cast<Shard *>(data.shard)->inlineShardId = NotInline;                             \
       } else {                                                                                   \
         OVERRIDE_ACTIVATE(data, activateSingle);                                                 \
         static_cast<Shard *>(data.shard)->inlineShardId = SHInlineShards::Math##NAME;            \
@@ -548,6 +739,33 @@ template <SHType SHT, typename FuncD, typename FuncF> struct UnaryOperation {
       return _result;                                                                            \
     }                                                                                            \
                                                                                                  \
+    SHVar activateArray(SHContext *context, const SHVar &input) {                                \
+      if (_result.valueType != SHType::Array) {                                                  \
+        destroyVar(_result);                                                                     \
+        _result.valueType = SHType::Array;                                                       \
+      }                                                                                          \
+      _result.innerType = input.innerType;                                                       \
+      const auto len = input.payload.arrayValue.len;                                             \
+      shards::arrayResize(_result.payload.arrayValue, len);                                      \
+      const auto src = input.payload.arrayValue.elements;                                        \
+      const auto dst = _result.payload.arrayValue.elements;                                      \
+      if (input.innerType == Float) {                                                            \
+        for (uint32_t i = 0; i < len; i++) {                                                     \
+          dst[i].floatValue = FUNC(src[i].floatValue);                                           \
+        }                                                                                        \
+      } else {                                                                                   \
+        SHVar item{};                                                                            \
+        item.valueType = input.innerType;                                                        \
+        SHVar scratch{};                                                                         \
+        for (uint32_t i = 0; i < len; i++) {                                                     \
+          item.payload = src[i];                                                                 \
+          operate(scratch, item);                                                                \
+          dst[i] = scratch.payload;                                                              \
+        }                                                                                        \
+      }                                                                                          \
+      return _result;                                                                            \
+    }                                                                                            \
+                                                                                                 \
     ALWAYS_INLINE SHVar activateSingle(SHContext *context, const SHVar &input) {                 \
       SHVar scratch;                                                                             \
       operate(scratch, input);                                                                   \
@@ -779,6 +997,7 @@ using Dec = UnaryBin<Subtract>;
 
 struct MaxOp final {
   static constexpr bool hasApply{};
+  static constexpr Simd::Op simdOp{Simd::Op::Max};
   template <typename T> T apply(const T &lhs, const T &rhs) { return std::max<T>(lhs, rhs); }
   ALWAYS_INLINE void operator()(SHVar &output, const SHVar &input, const SHVar &operand, void *) {
     output = std::max(input, operand);
@@ -788,6 +1007,7 @@ using Max = BinaryOperation<MaxOp>;
 
 struct MinOp final {
   static constexpr bool hasApply{};
+  static constexpr Simd::Op simdOp{Simd::Op::Min};
   template <typename T> T apply(const T &lhs, const T &rhs) { return std::min<T>(lhs, rhs); }
   ALWAYS_INLINE void operator()(SHVar &output, const SHVar &input, const SHVar &operand, void *) {
     output = std::min(input, operand);
@@ -0,0 +1,268 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright © 2019 Fragcolor Pte. Ltd. */
+
+#ifndef SH_CORE_SHARDS_MATH_SIMD
+#define SH_CORE_SHARDS_MATH_SIMD
+
+// Element wise kernels used by Math binary operations on homogeneous seqs and arrays.
+// Kernels only touch payloads, elements are spaced by a stride so the same code runs on
+// seqs (sizeof(SHVar)) and packed arrays (sizeof(SHVarPayload)).
+// x86_64 always has SSE2, AVX2 is picked at runtime for packed arrays.
+
+#include "shards.h"
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SH_MATH_SIMD_X86 1
+#endif
+
+namespace shards {
+namespace Math {
+namespace Simd {
+enum class Op { Add, Subtract, Multiply, Divide, Min, Max };
+
+// the payload member a kernel operates on
+enum class Lane { None, Int, Float, Float4 };
+
+inline Lane laneOf(SHType type) {
+  switch (type) {
+  case SHType::Int:
+    return Lane::Int;
+  case SHType::Float:
+    return Lane::Float;
+  case SHType::Float4:
+    return Lane::Float4;
+  default:
+    return Lane::None;
+  }
+}
+
+// Min and Max on vectors are not lane wise in the scalar ops (they compare whole vars)
+constexpr bool supported(Op op, Lane lane) {
+  return lane != Lane::None && !(lane == Lane::Float4 && (op == Op::Min || op == Op::Max));
+}
+
+struct Operands {
+  uint8_t *dst;
+  size_t dstStride;
+  const uint8_t *a;
+  size_t aStride;
+  const uint8_t *b;
+  size_t bStride; // 0 broadcasts a single operand
+
+  ALWAYS_INLINE SHVarPayload &dstAt(size_t i) const { return *reinterpret_cast<SHVarPayload *>(dst + i * dstStride); }
+  ALWAYS_INLINE const SHVarPayload &aAt(size_t i) const {
+    return *reinterpret_cast<const SHVarPayload *>(a + i * aStride);
+  }
+  ALWAYS_INLINE const SHVarPayload &bAt(size_t i) const {
+    return *reinterpret_cast<const SHVarPayload *>(b + i * bStride);
+  }
+
+  Operands offset(size_t i) const {
+    return {dst + i * dstStride, dstStride, a + i * aStride, aStride, b + i * bStride, bStride};
+  }
+};
+
+// same semantics as std::min/std::max used by the scalar ops
+template <Op O, typename T> ALWAYS_INLINE inline T scalar(T a, T b) {
+  if constexpr (O == Op::Add)
+    return a + b;
+  else if constexpr (O == Op::Subtract)
+    return a - b;
+  else if constexpr (O == Op::Multiply)
+    return a * b;
+  else if constexpr (O == Op::Divide)
+    return a / b;
+  else if constexpr (O == Op::Min)
+    return b < a ? b : a;
+  else
+    return a < b ? b : a;
+}
+
+template <Op O> void runScalar(Lane lane, const Operands &ops, size_t n) {
+  switch (lane) {
+  case Lane::Int:
+    for (size_t i = 0; i < n; i++)
+      ops.dstAt(i).intValue = scalar<O>(ops.aAt(i).intValue, ops.bAt(i).intValue);
+    break;
+  case Lane::Float:
+    for (size_t i = 0; i < n; i++)
+      ops.dstAt(i).floatValue = scalar<O>(ops.aAt(i).floatValue, ops.bAt(i).floatValue);
+    break;
+  case Lane::Float4:
+    for (size_t i = 0; i < n; i++) {
+      for (int j = 0; j < 4; j++)
+        ops.dstAt(i).float4Value[j] = scalar<O>(ops.aAt(i).float4Value[j], ops.bAt(i).float4Value[j]);
+    }
+    break;
+  case Lane::None:
+    break;
+  }
+}
+
+#if SH_MATH_SIMD_X86
+ALWAYS_INLINE inline float *floats(SHVarPayload &p) { return reinterpret_cast<float *>(&p.float4Value); }
+ALWAYS_INLINE inline const float *floats(const SHVarPayload &p) { return reinterpret_cast<const float *>(&p.float4Value); }
+
+// operands of min/max are swapped to select like std::min/std::max
+template <Op O> ALWAYS_INLINE inline __m128d opPd(__m128d a, __m128d b) {
+  if constexpr (O == Op::Add)
+    return _mm_add_pd(a, b);
+  else if constexpr (O == Op::Subtract)
+    return _mm_sub_pd(a, b);
+  else if constexpr (O == Op::Multiply)
+    return _mm_mul_pd(a, b);
+  else if constexpr (O == Op::Divide)
+    return _mm_div_pd(a, b);
+  else if constexpr (O == Op::Min)
+    return _mm_min_pd(b, a);
+  else
+    return _mm_max_pd(b, a);
+}
+
+template <Op O> ALWAYS_INLINE inline __m128 opPs(__m128 a, __m128 b) {
+  if constexpr (O == Op::Add)
+    return _mm_add_ps(a, b);
+  else if constexpr (O == Op::Subtract)
+    return _mm_sub_ps(a, b);
+  else if constexpr (O == Op::Multiply)
+    return _mm_mul_ps(a, b);
+  else
+    return _mm_div_ps(a, b);
+}
+
+// pairs of doubles are gathered in one register, any stride works
+template <Op O> void runSse2(Lane lane, const Operands &ops, size_t n) {
+  size_t i = 0;
+  switch (lane) {
+  case Lane::Float:
+    for (; i + 1 < n; i += 2) {
+      const auto a = _mm_loadh_pd(_mm_load_sd(&ops.aAt(i).floatValue), &ops.aAt(i + 1).floatValue);
+      const auto b = _mm_loadh_pd(_mm_load_sd(&ops.bAt(i).floatValue), &ops.bAt(i + 1).floatValue);
+      const auto r = opPd<O>(a, b);
+      _mm_storel_pd(&ops.dstAt(i).floatValue, r);
+      _mm_storeh_pd(&ops.dstAt(i + 1).floatValue, r);
+    }
+    break;
+  case Lane::Float4:
+    if constexpr (supported(O, Lane::Float4)) {
+      for (; i < n; i++) {
+        const auto r = opPs<O>(_mm_loadu_ps(floats(ops.aAt(i))), _mm_loadu_ps(floats(ops.bAt(i))));
+        _mm_storeu_ps(floats(ops.dstAt(i)), r);
+      }
+    }
+    break;
+  case Lane::Int:
+    // SSE2 has no 64 bit multiply, divide or compare
+    if constexpr (O == Op::Add || O == Op::Subtract) {
+      for (; i + 1 < n; i += 2) {
+        const auto a = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(&ops.aAt(i).intValue)),
+                                          _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&ops.aAt(i + 1).intValue)));
+        const auto b = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(&ops.bAt(i).intValue)),
+                                          _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&ops.bAt(i + 1).intValue)));
+        const auto r = O == Op::Add ? _mm_add_epi64(a, b) : _mm_sub_epi64(a, b);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(&ops.dstAt(i).intValue), r);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(&ops.dstAt(i + 1).intValue), _mm_unpackhi_epi64(r, r));
+      }
+    }
+    break;
+  case Lane::None:
+    break;
+  }
+  if (i < n)
+    runScalar<O>(lane, ops.offset(i), n - i);
+}
+
+// packed arrays only, two whole payloads per register, Int and Float leave the upper half of each
+// payload as padding, it gets computed too (b alone with a broadcast, NaN for 0/0) so it's zeroed before storing
+template <Op O> __attribute__((target("avx2"))) void runAvx2(Lane lane, const Operands &ops, size_t n) {
+  size_t i = 0;
+  const bool broadcast = ops.bStride == 0;
+  switch (lane) {
+  case Lane::Float: {
+    const auto b1 = _mm256_set1_pd(ops.bAt(0).floatValue);
+    for (; i + 1 < n; i += 2) {
+      const auto a = _mm256_loadu_pd(&ops.aAt(i).floatValue);
+      const auto b = broadcast ? b1 : _mm256_loadu_pd(&ops.bAt(i).floatValue);
+      __m256d r;
+      if constexpr (O == Op::Add)
+        r = _mm256_add_pd(a, b);
+      else if constexpr (O == Op::Subtract)
+        r = _mm256_sub_pd(a, b);
+      else if constexpr (O == Op::Multiply)
+        r = _mm256_mul_pd(a, b);
+      else if constexpr (O == Op::Divide)
+        r = _mm256_div_pd(a, b);
+      else if constexpr (O == Op::Min)
+        r = _mm256_min_pd(b, a);
+      else
+        r = _mm256_max_pd(b, a);
+      _mm256_storeu_pd(&ops.dstAt(i).floatValue, _mm256_blend_pd(r, _mm256_setzero_pd(), 0b1010));
+    }
+  } break;
+  case Lane::Float4:
+    if constexpr (supported(O, Lane::Float4)) {
+      const auto b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(&ops.bAt(0).float4Value));
+      for (; i + 1 < n; i += 2) {
+        const auto a = _mm256_loadu_ps(floats(ops.aAt(i)));
+        const auto b = broadcast ? b1 : _mm256_loadu_ps(floats(ops.bAt(i)));
+        __m256 r;
+        if constexpr (O == Op::Add)
+          r = _mm256_add_ps(a, b);
+        else if constexpr (O == Op::Subtract)
+          r = _mm256_sub_ps(a, b);
+        else if constexpr (O == Op::Multiply)
+          r = _mm256_mul_ps(a, b);
+        else
+          r = _mm256_div_ps(a, b);
+        _mm256_storeu_ps(floats(ops.dstAt(i)), r);
+      }
+    }
+    break;
+  case Lane::Int:
+    if constexpr (O == Op::Add || O == Op::Subtract) {
+      const auto b1 = _mm256_set1_epi64x(ops.bAt(0).intValue);
+      for (; i + 1 < n; i += 2) {
+        const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&ops.aAt(i).intValue));
+        const auto b = broadcast ? b1 : _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&ops.bAt(i).intValue));
+        const auto r = O == Op::Add ? _mm256_add_epi64(a, b) : _mm256_sub_epi64(a, b);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&ops.dstAt(i).intValue),
+                            _mm256_blend_epi32(r, _mm256_setzero_si256(), 0b11001100));
+      }
+    }
+    break;
+  case Lane::None:
+    break;
+  }
+  if (i < n)
+    runScalar<O>(lane, ops.offset(i), n - i);
+}
+
+inline bool hasAvx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+#endif
+
+// applies O on n elements, lane must be supported(O, lane)
+template <Op O> void run(Lane lane, const Operands &ops, size_t n) {
+  if (n == 0)
+    return;
+#if SH_MATH_SIMD_X86
+  constexpr size_t Packed = sizeof(SHVarPayload);
+  if (ops.dstStride == Packed && ops.aStride == Packed && (ops.bStride == Packed || ops.bStride == 0) && hasAvx2()) {
+    runAvx2<O>(lane, ops, n);
+  } else {
+    runSse2<O>(lane, ops, n);
+  }
+#else
+  runScalar<O>(lane, ops, n);
+#endif
+}
+} // namespace Simd
+} // namespace Math
+} // namespace shards
+
+#endif
@@ -5,6 +5,7 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include "shared.hpp"
+#include "mapped_file.hpp"
 #include <boost/filesystem.hpp>
 #include <fstream>
 #include <future>
@@ -159,11 +160,42 @@ struct ReadFile : public FileBase {
   static SHTypesInfo inputTypes() { return CoreInfo::NoneType; }
 
   std::ifstream _fileStream;
+  std::optional<BorrowingReader> _mappedReader;
+  bool _memoryMap = false;
   SHVar _output{};
 
+  static inline Parameters params{FileBase::params,
+                                  {{"MemoryMap",
+                                    SHCCSTR("If the file should be memory mapped, large Bytes, Image and Audio values "
+                                            "are then views of the file rather than copies."),
+                                    {CoreInfo::BoolType}}}};
+
+  static SHParametersInfo parameters() { return params; }
+
+  void setParam(int index, const SHVar &value) {
+    switch (index) {
+    case 1:
+      _memoryMap = value.payload.boolValue;
+      break;
+    default:
+      FileBase::setParam(index, value);
+    }
+  }
+
+  SHVar getParam(int index) {
+    switch (index) {
+    case 1:
+      return Var(_memoryMap);
+    default:
+      return FileBase::getParam(index);
+    }
+  }
+
   void cleanup() {
     Serialization::varFree(_output);
+    serial.reset();
     _fileStream = {};
+    _mappedReader.reset();
     FileBase::cleanup();
   }
 
@@ -176,21 +208,35 @@ struct ReadFile : public FileBase {
   Serialization serial;
 
   SHVar activate(SHContext *context, const SHVar &input) {
-    if (!_fileStream.is_open() || (_filename.isVariable() && _filename.get() != _currentFileName)) {
+    const auto opened = _mappedReader || _fileStream.is_open();
+    if (!opened || (_filename.isVariable() && _filename.get() != _currentFileName)) {
       std::string filename;
       if (!getFilename(context, filename)) {
         return Var::Empty;
       }
 
-      _fileStream = std::ifstream(filename, std::ios::binary);
+      _fileStream = {};
+      _mappedReader.reset();
+      if (_memoryMap) {
+        auto file = MappedFile::open(filename);
+        _mappedReader.emplace(file, file->data(), file->size());
+      } else {
+        _fileStream = std::ifstream(filename, std::ios::binary);
+      }
     }
 
-    if (_fileStream.peek() == EOF)
+    const auto atEnd = _mappedReader ? _mappedReader->offset == _mappedReader->size : _fileStream.peek() == EOF;
+    if (atEnd)
       return Var::Empty;
 
-    Reader r(_fileStream);
+    // every record is self contained in both modes, this also lets go of the views of the previous one
     serial.reset();
-    serial.deserialize(r, _output);
+    if (_mappedReader) {
+      serial.deserialize(*_mappedReader, _output);
+    } else {
+      Reader r(_fileStream);
+      serial.deserialize(r, _output);
+    }
     return _output;
   }
 };
@@ -258,8 +304,13 @@ struct LoadImage : public FileBase {
   static SHTypesInfo inputTypes() { return CoreInfo::NoneType; }
   static SHTypesInfo outputTypes() { return CoreInfo::ImageType; }
 
-  static inline Parameters params{FileBase::params,
-                                  {{"BPP", SHCCSTR("bits per pixel (HDR images loading and such!)"), {BPPEnumInfo}}}};
+  static inline Parameters params{
+      FileBase::params,
+      {{"BPP", SHCCSTR("bits per pixel (HDR images loading and such!)"), {BPPEnumInfo}},
+       {"Cache",
+        SHCCSTR("Share decoded images between activations and LoadImage shards reading the same file, the file is decoded "
+                "again only when its modification time changes."),
+        {CoreInfo::BoolType}}}};
 
   static SHParametersInfo parameters() { return params; }
 
@@ -268,6 +319,9 @@ struct LoadImage : public FileBase {
     case 1:
       _bpp = BPP(value.payload.enumValue);
       break;
+    case 2:
+      _cache = value.payload.boolValue;
+      break;
     default:
       FileBase::setParam(index, value);
     }
@@ -277,66 +331,126 @@ struct LoadImage : public FileBase {
     switch (index) {
     case 1:
       return Var::Enum(_bpp, CoreCC, 'ibpp');
+    case 2:
+      return Var(_cache);
     default:
       return FileBase::getParam(index);
     }
   }
 
+  // pixels are never written once decoded, shards sharing an entry hand out copies of them
+  struct Decoded {
+    SHImage image{};
+    std::time_t mtime{};
+
+    ~Decoded() {
+      if (image.data)
+        stbi_image_free(image.data);
+    }
+  };
+
+  // entries only live as long as some shard holds them
+  static inline std::mutex _cacheMutex;
+  static inline std::unordered_map<std::string, std::weak_ptr<Decoded>> _cacheEntries;
+
   SHVar _output{};
   BPP _bpp{BPP::u8};
+  bool _cache{false};
+  std::shared_ptr<Decoded> _decoded;
+  std::vector<uint8_t> _pixels;
 
   void cleanup() {
-    if (_output.valueType == Image && _output.payload.imageValue.data) {
-      stbi_image_free(_output.payload.imageValue.data);
-      _output = Var::Empty;
-    }
+    _decoded.reset();
+    _pixels.clear();
+    _output = Var::Empty;
 
     FileBase::cleanup();
   }
 
-  SHVar activate(SHContext *context, const SHVar &input) {
-    std::string filename;
-    if (!getFilename(context, filename)) {
-      throw ActivationError("File not found!");
-    }
-
-    if (_output.valueType == Image && _output.payload.imageValue.data) {
-      stbi_image_free(_output.payload.imageValue.data);
-      _output = Var::Empty;
-    }
-
-    _output.valueType = Image;
+  std::shared_ptr<Decoded> decode(const std::string &filename) {
+    auto decoded = std::make_shared<Decoded>();
     int x, y, n;
     if (_bpp == BPP::u8) {
-      _output.payload.imageValue.data = (uint8_t *)stbi_load(filename.c_str(), &x, &y, &n, 0);
-      if (!_output.payload.imageValue.data) {
-        throw ActivationError("Failed to load image file");
-      }
+      decoded->image.data = (uint8_t *)stbi_load(filename.c_str(), &x, &y, &n, 0);
     } else if (_bpp == BPP::u16) {
-      _output.payload.imageValue.data = (uint8_t *)stbi_load_16(filename.c_str(), &x, &y, &n, 0);
-      if (!_output.payload.imageValue.data) {
-        throw ActivationError("Failed to load image file");
-      }
+      decoded->image.data = (uint8_t *)stbi_load_16(filename.c_str(), &x, &y, &n, 0);
     } else {
-      _output.payload.imageValue.data = (uint8_t *)stbi_loadf(filename.c_str(), &x, &y, &n, 0);
-      if (!_output.payload.imageValue.data) {
-        throw ActivationError("Failed to load image file");
-      }
+      decoded->image.data = (uint8_t *)stbi_loadf(filename.c_str(), &x, &y, &n, 0);
     }
-    _output.payload.imageValue.width = uint16_t(x);
-    _output.payload.imageValue.height = uint16_t(y);
-    _output.payload.imageValue.channels = uint16_t(n);
+    if (!decoded->image.data) {
+      throw ActivationError("Failed to load image file");
+    }
+    decoded->image.width = uint16_t(x);
+    decoded->image.height = uint16_t(y);
+    decoded->image.channels = uint16_t(n);
     switch (_bpp) {
     case BPP::u16:
-      _output.payload.imageValue.flags = SHIMAGE_FLAGS_16BITS_INT;
+      decoded->image.flags = SHIMAGE_FLAGS_16BITS_INT;
       break;
     case BPP::f32:
-      _output.payload.imageValue.flags = SHIMAGE_FLAGS_32BITS_FLOAT;
+      decoded->image.flags = SHIMAGE_FLAGS_32BITS_FLOAT;
       break;
     default:
-      _output.payload.imageValue.flags = 0;
+      decoded->image.flags = 0;
       break;
     }
+    return decoded;
+  }
+
+  std::shared_ptr<Decoded> cached(const std::string &filename) {
+    const auto path = fs::canonical(filename);
+    const auto mtime = fs::last_write_time(path);
+    const auto key = fmt::format("{}:{}", magic_enum::enum_name(_bpp), path.string());
+
+    {
+      std::scoped_lock lock(_cacheMutex);
+      auto it = _cacheEntries.find(key);
+      if (it != _cacheEntries.end()) {
+        if (auto decoded = it->second.lock(); decoded && decoded->mtime == mtime)
+          return decoded;
+      }
+    }
+
+    // decode outside of the lock, two shards racing on the same file just decode it twice
+    auto decoded = decode(filename);
+    decoded->mtime = mtime;
+
+    std::scoped_lock lock(_cacheMutex);
+    for (auto it = _cacheEntries.begin(); it != _cacheEntries.end();) {
+      if (it->second.expired())
+        it = _cacheEntries.erase(it);
+      else
+        ++it;
+    }
+    _cacheEntries[key] = decoded;
+    return decoded;
+  }
+
+  SHVar activate(SHContext *context, const SHVar &input) {
+    std::string filename;
+    if (!getFilename(context, filename)) {
+      throw ActivationError("File not found!");
+    }
+
+    if (_cache) {
+      // keep holding the previous image during the lookup so that it is still alive in the cache
+      _decoded = cached(filename);
+    } else {
+      _decoded.reset();
+      _decoded = decode(filename);
+    }
+
+    _output = Var::Empty;
+    _output.valueType = Image;
+    _output.payload.imageValue = _decoded->image;
+    if (_cache) {
+      // downstream shards may write into their input, never let them reach the shared pixels
+      const auto &image = _decoded->image;
+      const size_t pixsize = _bpp == BPP::u8 ? 1 : _bpp == BPP::u16 ? 2 : 4;
+      const size_t size = size_t(image.width) * size_t(image.height) * size_t(image.channels) * pixsize;
+      _pixels.assign(image.data, image.data + size);
+      _output.payload.imageValue.data = _pixels.data();
+    }
     return _output;
   }
 };
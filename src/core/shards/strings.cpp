@@ -42,18 +42,19 @@ struct Common {
 struct Match : public Common {
   IterableSeq _output;
   std::vector<std::string> _pool;
+  // kept so that its storage is reused across activations
+  std::smatch _match;
 
   static SHTypesInfo outputTypes() { return CoreInfo::StringSeqType; }
 
   SHVar activate(SHContext *context, const SHVar &input) {
-    std::smatch match;
     _subject.assign(input.payload.stringValue, SHSTRLEN(input));
-    if (std::regex_match(_subject, match, _re)) {
-      auto size = match.size();
+    if (std::regex_match(_subject, _match, _re)) {
+      auto size = _match.size();
       _pool.resize(size);
       _output.resize(size);
       for (size_t i = 0; i < size; i++) {
-        _pool[i].assign(match[i].str());
+        _pool[i].assign(_match[i].first, _match[i].second);
         _output[i] = Var(_pool[i]);
       }
     } else {
@@ -67,20 +68,21 @@ struct Match : public Common {
 struct Search : public Common {
   IterableSeq _output;
   std::vector<std::string> _pool;
+  std::smatch _match;
 
   static SHTypesInfo outputTypes() { return CoreInfo::StringSeqType; }
 
   SHVar activate(SHContext *context, const SHVar &input) {
-    std::smatch match;
     _subject.assign(input.payload.stringValue, SHSTRLEN(input));
     _pool.clear();
     _output.clear();
-    while (std::regex_search(_subject, match, _re)) {
-      auto size = match.size();
+    auto begin = _subject.cbegin();
+    while (std::regex_search(begin, _subject.cend(), _match, _re)) {
+      auto size = _match.size();
       for (size_t i = 0; i < size; i++) {
-        _pool.emplace_back(match[i].str());
+        _pool.emplace_back(_match[i].first, _match[i].second);
       }
-      _subject.assign(match.suffix());
+      begin = _match.suffix().first;
     }
     for (auto &s : _pool) {
       _output.push_back(Var(s));
@@ -15,9 +15,80 @@ namespace shards {
 namespace DSP {
 static TableVar experimental{{"experimental", Var(true)}};
 
+// kiss_fft plans by size and direction, shared by all the shards of a thread.
+// Plans hold the scratch memory of a transform so they cannot be shared across threads,
+// shards look them up on each activation rather than keeping pointers into another thread's cache.
+// Lengths can follow the input, so past MaxPlans per kind the least recently used plan is freed,
+// a plan pointer is only valid until the next lookup.
+struct Plans {
+  static constexpr size_t MaxPlans = 16;
+
+  template <typename Cfg> struct Cache {
+    struct Entry {
+      Cfg plan;
+      uint64_t lastUse;
+    };
+    std::unordered_map<int, Entry> entries;
+    uint64_t clock{0};
+    void (*release)(Cfg);
+
+    Cache(void (*release)(Cfg)) : release(release) {}
+
+    ~Cache() {
+      for (auto &[_, entry] : entries)
+        release(entry.plan);
+    }
+
+    template <typename Alloc> Cfg get(int len, Alloc alloc) {
+      auto it = entries.find(len);
+      if (likely(it != entries.end())) {
+        it->second.lastUse = ++clock;
+        return it->second.plan;
+      }
+
+      auto plan = alloc();
+      if (entries.size() >= MaxPlans) {
+        auto oldest = std::min_element(entries.begin(), entries.end(),
+                                       [](auto &a, auto &b) { return a.second.lastUse < b.second.lastUse; });
+        release(oldest->second.plan);
+        entries.erase(oldest);
+      }
+      entries.emplace(len, Entry{plan, ++clock});
+      return plan;
+    }
+  };
+
+  Cache<kiss_fft_cfg> complex[2]{{[](kiss_fft_cfg plan) { kiss_fft_free(plan); }},
+                                 {[](kiss_fft_cfg plan) { kiss_fft_free(plan); }}};
+  Cache<kiss_fftr_cfg> real[2]{{[](kiss_fftr_cfg plan) { kiss_fftr_free(plan); }},
+                               {[](kiss_fftr_cfg plan) { kiss_fftr_free(plan); }}};
+
+  static Plans &get() {
+    thread_local Plans plans;
+    return plans;
+  }
+
+  static kiss_fft_cfg complexPlan(int len, bool inverse) {
+    return get().complex[inverse].get(len, [&]() {
+      auto plan = kiss_fft_alloc(len, inverse, 0, 0);
+      if (!plan)
+        throw ActivationError("Failed to allocate FFT plan");
+      return plan;
+    });
+  }
+
+  // real transforms need an even length
+  static kiss_fftr_cfg realPlan(int len, bool inverse) {
+    return get().real[inverse].get(len, [&]() {
+      auto plan = kiss_fftr_alloc(len, inverse, 0, 0);
+      if (!plan)
+        throw ActivationError("Failed to allocate real FFT plan, the length must be even");
+      return plan;
+    });
+  }
+};
+
 struct FFTBase {
-  kiss_fft_cfg _state{nullptr};
-  kiss_fftr_cfg _rstate{nullptr};
   int _currentWindow{-1};
   std::vector<kiss_fft_cpx> _cscratch;
   std::vector<kiss_fft_cpx> _cscratch2;
@@ -26,17 +97,7 @@ struct FFTBase {
 
   static inline Types FloatTypes{{CoreInfo::FloatSeqType, CoreInfo::Float2SeqType, CoreInfo::AudioType}};
 
-  void cleanup() {
-    if (_state) {
-      kiss_fft_free(_state);
-      _state = nullptr;
-    }
-
-    if (_rstate) {
-      kiss_fftr_free(_rstate);
-      _rstate = nullptr;
-    }
-  }
+  void cleanup() { _currentWindow = -1; }
 };
 
 struct FFT : public FFTBase {
@@ -84,16 +145,10 @@ struct FFT : public FFTBase {
     }
 
     if (unlikely(_currentWindow != len)) {
-      cleanup();
-
       if constexpr (ITYPE == SHType::Float2) {
-        _state = kiss_fft_alloc(len, 0, 0, 0);
         _cscratch2.resize(len);
       } else if constexpr (ITYPE == SHType::Float) {
-        _rstate = kiss_fftr_alloc(len, 0, 0, 0);
         _fscratch.resize(len);
-      } else {
-        _rstate = kiss_fftr_alloc(len, 0, 0, 0);
       }
       _currentWindow = len;
       _cscratch.resize(flen);
@@ -105,15 +160,15 @@ struct FFT : public FFTBase {
       for (const auto &fvar : input) {
         _cscratch2[idx++] = {float(fvar.payload.float2Value[0]), float(fvar.payload.float2Value[1])};
       }
-      kiss_fft(_state, _cscratch2.data(), _cscratch.data());
+      kiss_fft(Plans::complexPlan(len, false), _cscratch2.data(), _cscratch.data());
     } else if constexpr (ITYPE == SHType::Float) {
       int idx = 0;
       for (const auto &fvar : input) {
         _fscratch[idx++] = float(fvar.payload.floatValue);
       }
-      kiss_fftr(_rstate, _fscratch.data(), _cscratch.data());
+      kiss_fftr(Plans::realPlan(len, false), _fscratch.data(), _cscratch.data());
     } else {
-      kiss_fftr(_rstate, input.payload.audioValue.samples, _cscratch.data());
+      kiss_fftr(Plans::realPlan(len, false), input.payload.audioValue.samples, _cscratch.data());
     }
 
     for (int i = 0; i < flen; i++) {
@@ -193,8 +248,6 @@ struct IFFT : public FFTBase {
     const int olen = len * 2 - 2;
 
     if (unlikely(_currentWindow != len)) {
-      cleanup();
-
       _currentWindow = len;
       _cscratch.resize(len);
       if constexpr (OTYPE == SHType::Float) {
@@ -206,11 +259,6 @@ struct IFFT : public FFTBase {
       }
       if constexpr (OTYPE == SHType::Audio || OTYPE == SHType::Float) {
         _fscratch.resize(olen);
-        _rstate = kiss_fftr_alloc(olen, 1, 0, 0);
-        SHLOG_TRACE("IFFT alloc window {}", olen);
-      } else {
-        _state = kiss_fft_alloc(len, 1, 0, 0);
-        SHLOG_TRACE("IFFT alloc window {}", len);
       }
     }
 
@@ -220,11 +268,11 @@ struct IFFT : public FFTBase {
     }
 
     if constexpr (OTYPE == SHType::Audio) {
-      kiss_fftri(_rstate, _cscratch.data(), _fscratch.data());
+      kiss_fftri(Plans::realPlan(olen, true), _cscratch.data(), _fscratch.data());
 
       return Var(SHAudio{0, uint16_t(olen), uint16_t(1), _fscratch.data()});
     } else if constexpr (OTYPE == SHType::Float) {
-      kiss_fftri(_rstate, _cscratch.data(), _fscratch.data());
+      kiss_fftri(Plans::realPlan(olen, true), _cscratch.data(), _fscratch.data());
 
       for (int i = 0; i < olen; i++) {
         _vscratch[i].payload.floatValue = double(_fscratch[i]);
@@ -232,7 +280,7 @@ struct IFFT : public FFTBase {
 
       return Var(_vscratch);
     } else {
-      kiss_fft(_state, _cscratch.data(), _cscratch2.data());
+      kiss_fft(Plans::complexPlan(len, true), _cscratch.data(), _cscratch2.data());
 
       for (int i = 0; i < len; i++) {
         _vscratch[i].payload.float2Value[0] = _cscratch2[i].r;
@@ -250,6 +298,186 @@ struct IFFT : public FFTBase {
   SHVar activate(SHContext *context, const SHVar &input) { return tactivate<SHType::Float2>(context, input); }
 };
 
+// Short time Fourier transform of a stream, samples are buffered across activations
+// and every window that completes is transformed.
+// Frames are rows of a float image so the spectrogram stays packed instead of boxed in vars.
+struct STFT {
+  enum class Window { Rectangular, Hann, Hamming, Blackman };
+  static inline EnumInfo<Window> WindowEnum{"WindowFunction", CoreCC, 'dspw'};
+  static inline Type WindowEnumInfo{{SHType::Enum, {.enumeration = {CoreCC, 'dspw'}}}};
+
+  static inline Types InputTypes{{CoreInfo::AudioType, CoreInfo::FloatSeqType}};
+
+  static SHTypesInfo inputTypes() { return InputTypes; }
+  static SHTypesInfo outputTypes() { return CoreInfo::ImageType; }
+
+  static const SHTable *properties() { return &experimental.payload.tableValue; }
+
+  static SHOptionalString help() {
+    return SHCCSTR("Splits a stream of samples in overlapping windows and transforms each one. Outputs a 32 bits float "
+                   "image with a row per frame completed by this input (possibly none) and a column per frequency bin, "
+                   "with 2 channels (real, imaginary) or 1 channel of magnitudes. Multi channel audio is mixed down.");
+  }
+
+  static inline Parameters Params{
+      {"Size", SHCCSTR("The length of each window in samples, must be even."), {CoreInfo::IntType}},
+      {"Hop", SHCCSTR("How many samples the window advances between frames."), {CoreInfo::IntType}},
+      {"Window", SHCCSTR("The window function applied to each frame."), {WindowEnumInfo}},
+      {"Magnitude", SHCCSTR("If the output should be the magnitude of each bin instead of complex numbers."),
+       {CoreInfo::BoolType}}};
+
+  SHParametersInfo parameters() { return Params; }
+
+  void setParam(int index, const SHVar &value) {
+    switch (index) {
+    case 0:
+      _size = int(value.payload.intValue);
+      break;
+    case 1:
+      _hop = int(value.payload.intValue);
+      break;
+    case 2:
+      _windowFunction = Window(value.payload.enumValue);
+      break;
+    case 3:
+      _magnitude = value.payload.boolValue;
+      break;
+    default:
+      throw InvalidParameterIndex();
+    }
+  }
+
+  SHVar getParam(int index) {
+    switch (index) {
+    case 0:
+      return Var(int64_t(_size));
+    case 1:
+      return Var(int64_t(_hop));
+    case 2:
+      return Var::Enum(_windowFunction, CoreCC, 'dspw');
+    case 3:
+      return Var(_magnitude);
+    default:
+      throw InvalidParameterIndex();
+    }
+  }
+
+  SHTypeInfo compose(const SHInstanceData &data) {
+    if (_size <= 0 || _size % 2 != 0)
+      throw ComposeError("DSP.STFT: Size must be a positive even number");
+    // bins are the columns of the output image
+    if (_size / 2 + 1 > UINT16_MAX)
+      throw ComposeError("DSP.STFT: Size is too large, Size / 2 + 1 bins must fit the image width");
+    if (_hop <= 0)
+      throw ComposeError("DSP.STFT: Hop must be positive");
+    return CoreInfo::ImageType;
+  }
+
+  void warmup(SHContext *context) {
+    // periodic windows, as used for spectral analysis
+    _window.resize(_size);
+    const double step = 2.0 * M_PI / double(_size);
+    for (int i = 0; i < _size; i++) {
+      switch (_windowFunction) {
+      case Window::Rectangular:
+        _window[i] = 1.0f;
+        break;
+      case Window::Hann:
+        _window[i] = float(0.5 - 0.5 * std::cos(step * i));
+        break;
+      case Window::Hamming:
+        _window[i] = float(0.54 - 0.46 * std::cos(step * i));
+        break;
+      case Window::Blackman:
+        _window[i] = float(0.42 - 0.5 * std::cos(step * i) + 0.08 * std::cos(2.0 * step * i));
+        break;
+      }
+    }
+    _frame.resize(_size);
+    _bins.resize(_size / 2 + 1);
+  }
+
+  void cleanup() {
+    _pending.clear();
+    _skip = 0;
+  }
+
+  void push(float sample) {
+    if (_skip > 0)
+      _skip--;
+    else
+      _pending.push_back(sample);
+  }
+
+  SHVar activate(SHContext *context, const SHVar &input) {
+    if (input.valueType == SHType::Audio) {
+      const auto &audio = input.payload.audioValue;
+      const auto channels = std::max<uint32_t>(1, audio.channels);
+      const float scale = 1.0f / float(channels);
+      for (uint32_t i = 0; i < audio.nsamples; i++) {
+        float sample = 0.0f;
+        for (uint32_t c = 0; c < channels; c++)
+          sample += audio.samples[i * channels + c];
+        push(sample * scale);
+      }
+    } else {
+      for (const auto &sample : input) {
+        push(float(sample.payload.floatValue));
+      }
+    }
+
+    const size_t size = size_t(_size);
+    const size_t hop = size_t(_hop);
+    const size_t bins = _bins.size();
+    const size_t channels = _magnitude ? 1 : 2;
+    size_t frames = _pending.size() >= size ? (_pending.size() - size) / hop + 1 : 0;
+    // image height limit, the rest stays pending for the next activation
+    frames = std::min<size_t>(frames, UINT16_MAX);
+
+    _output.resize(frames * bins * channels);
+    auto plan = Plans::realPlan(_size, false);
+    for (size_t f = 0; f < frames; f++) {
+      const float *samples = &_pending[f * hop];
+      for (size_t i = 0; i < size; i++)
+        _frame[i] = samples[i] * _window[i];
+
+      kiss_fftr(plan, _frame.data(), _bins.data());
+
+      float *row = &_output[f * bins * channels];
+      if (_magnitude) {
+        for (size_t i = 0; i < bins; i++)
+          row[i] = std::sqrt(_bins[i].r * _bins[i].r + _bins[i].i * _bins[i].i);
+      } else {
+        for (size_t i = 0; i < bins; i++) {
+          row[i * 2] = _bins[i].r;
+          row[i * 2 + 1] = _bins[i].i;
+        }
+      }
+    }
+
+    // a hop longer than the window skips samples that did not arrive yet
+    const size_t consumed = frames * hop;
+    const size_t available = std::min(consumed, _pending.size());
+    _pending.erase(_pending.begin(), _pending.begin() + available);
+    _skip += consumed - available;
+
+    return Var(reinterpret_cast<uint8_t *>(_output.data()), uint16_t(bins), uint16_t(frames), uint8_t(channels),
+               SHIMAGE_FLAGS_32BITS_FLOAT);
+  }
+
+private:
+  int _size{1024};
+  int _hop{512};
+  Window _windowFunction{Window::Hann};
+  bool _magnitude{false};
+  std::vector<float> _window;
+  std::vector<float> _pending;
+  size_t _skip{0};
+  std::vector<float> _frame;
+  std::vector<kiss_fft_cpx> _bins;
+  std::vector<float> _output;
+};
+
 #if 0
 // TODO this works but we need to add more types, specifically orthogonal ones
 // TODO also add coverage of all cases
@@ -504,6 +732,7 @@ struct IWT : public WTBase {
 void registerShards() {
   REGISTER_SHARD("DSP.FFT", FFT);
   REGISTER_SHARD("DSP.IFFT", IFFT);
+  REGISTER_SHARD("DSP.STFT", STFT);
 #if 0
   REGISTER_SHARD("DSP.Wavelet", WT);
   REGISTER_SHARD("DSP.InverseWavelet", IWT);
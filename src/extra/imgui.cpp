@@ -2233,9 +2233,8 @@ struct TextInput : public Variable<SHType::String> {
       // Resize string callback
       if (it->_variable.isVariable()) {
         auto &var = it->_variable.get();
-        delete[] var.payload.stringValue;
-        var.payload.stringCapacity = data->BufTextLen * 2;
-        var.payload.stringValue = new char[var.payload.stringCapacity];
+        destroyString(var);
+        var.payload.stringValue = allocString(data->BufTextLen * 2, var.payload.stringCapacity);
         data->Buf = (char *)var.payload.stringValue;
       } else {
         it->_buffer.resize(data->BufTextLen * 2);
@@ -2253,9 +2252,8 @@ struct TextInput : public Variable<SHType::String> {
       auto &var = _variable.get();
       // we own the variable so let's run some init
       var.valueType = SHType::String;
-      var.payload.stringValue = new char[32];
-      var.payload.stringCapacity = 32;
-      memset((void *)var.payload.stringValue, 0x0, 32);
+      var.payload.stringValue = allocString(31, var.payload.stringCapacity);
+      memset((void *)var.payload.stringValue, 0x0, var.payload.stringCapacity + 1);
     }
 
     auto *hint = _hint.size() > 0 ? _hint.c_str() : nullptr;
@@ -116,6 +116,7 @@ void installSHCore(const malEnvPtr &env, const char *exePath, const char *script
   // Wire params
   env->set(":Looped", mal::keyword(":Looped"));
   env->set(":Unsafe", mal::keyword(":Unsafe"));
+  env->set(":Compiled", mal::keyword(":Compiled"));
   env->set(":LStack", mal::keyword(":LStack"));
   env->set(":SStack", mal::keyword(":SStack"));
   // SHType
@@ -876,6 +877,11 @@ BUILTIN(".") {
 
 BUILTIN("Mesh") {
   auto mesh = new malSHMesh();
+  if (argsBegin != argsEnd) {
+    // (Mesh 8) opts into ticking flows on 8 worker threads
+    ARG(malNumber, workers);
+    mesh->value()->setWorkers(uint32_t(workers->value()));
+  }
   return malValuePtr(mesh);
 }
 
@@ -1332,6 +1338,8 @@ BUILTIN("Wire") {
         wire->looped = true;
       } else if (v->value() == ":Unsafe") {
         wire->unsafe = true;
+      } else if (v->value() == ":Compiled") {
+        wire->compiled = true;
       } else if (v->value() == ":LStack") {
         wire->stackSize = 4 * 1024 * 1024;  // 4mb
       } else if (v->value() == ":SStack") { // default is 128kb
@@ -1658,6 +1666,13 @@ BUILTIN("run") {
       // swap states and invalidate stuff
       if (sleepTime <= 0.0) {
         shards::sleep(-1.0);
+        // if every wire is suspended block until the first one wakes up or a parked one is woken,
+        // run loop callbacks still need to be called regularly tho
+        auto deadline = mesh->nextWakeUp();
+        if (!shards::GetGlobals().RunLoopHooks.empty()) {
+          deadline = std::min<SHDuration>(deadline, SHClock::now().time_since_epoch() + SHDuration(1.0 / 60.0));
+        }
+        mesh->waitForWork(deadline);
       } else {
         // remove the time we took to tick from sleep
         now = SHClock::now();
@@ -1692,6 +1707,16 @@ BUILTIN("run") {
   return mal::boolean(true);
 }
 
+BUILTIN("mesh-worker-ticks") {
+  CHECK_ARGS_IS(1);
+  ARG(malSHMesh, mesh);
+  auto vec = new malValueVec();
+  for (auto ticks : mesh->value()->workerTicks()) {
+    vec->emplace_back(mal::number(double(ticks), true));
+  }
+  return malValuePtr(new malList(vec));
+}
+
 BUILTIN("sleep") {
   CHECK_ARGS_IS(1);
   ARG(malNumber, sleepTime);
@@ -0,0 +1,368 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright © 2020 Fragcolor Pte. Ltd. */
+
+// Microbenchmarks of the runtime core, results are printed as JSON
+// usage: bench-runtime [--out results.json] [--wires 1,1000]
+// larger meshes are opt-in, e.g. --wires 1,1000,100000 (needs a raised vm.max_map_count on Linux)
+// compare the output of two releases to catch regressions
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#include "nlohmann/json.hpp"
+
+#include "../../include/utility.hpp"
+#include "../core/runtime.hpp"
+
+using namespace shards;
+
+namespace {
+constexpr int Samples = 5;
+
+nlohmann::json results = nlohmann::json::array();
+
+// runs f iterations times per sample and records the best time per operation
+template <typename F> double bench(std::string_view name, uint64_t iterations, uint64_t opsPerIteration, F &&f) {
+  // warm up caches and lazily pinned state
+  f();
+
+  double best = std::numeric_limits<double>::max();
+  for (int s = 0; s < Samples; s++) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++) {
+      f();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count() / double(iterations * opsPerIteration));
+  }
+
+  SHLOG_INFO("{}: {:.2f} ns/op", name, best);
+  results.push_back({{"name", name}, {"iterations", iterations * opsPerIteration}, {"ns_per_op", best}});
+  return best;
+}
+
+// how many times faster the optimized case is than the baseline one
+void speedup(std::string_view name, double baseline, double optimized) {
+  const auto ratio = baseline / optimized;
+  SHLOG_INFO("{}: {:.2f}x", name, ratio);
+  results.push_back({{"name", name}, {"speedup", ratio}});
+}
+
+void failed(std::string_view name, const std::exception &e) {
+  SHLOG_ERROR("{}: {}", name, e.what());
+  results.push_back({{"name", name}, {"error", e.what()}});
+}
+
+struct Writer {
+  std::vector<uint8_t> &_buffer;
+  Writer(std::vector<uint8_t> &stream) : _buffer(stream) {}
+  void operator()(const uint8_t *buf, size_t size) { _buffer.insert(_buffer.end(), buf, buf + size); }
+};
+
+struct Reader {
+  const std::vector<uint8_t> &_buffer;
+  size_t _offset{0};
+  Reader(const std::vector<uint8_t> &buffer) : _buffer(buffer) {}
+  void operator()(uint8_t *buf, size_t size) {
+    if (_buffer.size() < _offset + size) {
+      throw ActivationError("Reader buffer underrun");
+    }
+
+    memcpy(buf, _buffer.data() + _offset, size);
+    _offset += size;
+  }
+};
+
+// ticks a looped wire, each tick activates `shards` shards
+double benchWire(std::string_view name, shards::Wire &wire, uint64_t shards, uint64_t iterations = 1000) {
+  auto mesh = SHMesh::make();
+  mesh->schedule(wire);
+  auto best = bench(name, iterations, shards, [&]() { mesh->tick(); });
+  mesh->terminate();
+  return best;
+}
+
+void benchActivation() {
+  // Const is dispatched inline, Math.Add goes through the shard activate pointer unless inlined
+  auto consts = shards::Wire("bench-activation-const").looped(true);
+  for (int i = 0; i < 1000; i++) {
+    consts.let(i);
+  }
+  benchWire("activation.const", consts, 1000);
+
+  auto adds = shards::Wire("bench-activation-add").looped(true).let(0);
+  for (int i = 0; i < 1000; i++) {
+    adds.shard("Math.Add", 1);
+  }
+  benchWire("activation.math-add", adds, 1000);
+}
+
+void benchVariables() {
+  auto wire = shards::Wire("bench-variables").looped(true).let(1);
+  for (int i = 0; i < 500; i++) {
+    wire.shard("Set", "x").shard("Get", "x");
+  }
+  benchWire("variables.set-get", wire, 1000);
+
+  // same loop interpreted and fused into a superinstruction by compiled wires
+  auto updates = [](std::string_view name, bool compiled) {
+    auto update = shards::Wire(name).looped(true).compiled(compiled).let(0).shard("Set", "x");
+    for (int i = 0; i < 500; i++) {
+      update.shard("Get", "x").shard("Math.Add", 1).shard("Update", "x");
+    }
+    return update;
+  };
+  auto interpreted = updates("bench-variables-update", false);
+  auto base = benchWire("variables.get-add-update", interpreted, 1500);
+  auto compiled = updates("bench-variables-update-compiled", true);
+  auto fused = benchWire("variables.get-add-update-compiled", compiled, 1500);
+  speedup("variables.get-add-update.speedup", base, fused);
+}
+
+void benchTables() {
+  TableVar table;
+  for (int i = 0; i < 64; i++) {
+    table[fmt::format("key-{}", i)] = Var(i);
+  }
+  auto wire = shards::Wire("bench-tables-take").looped(true).let(table).shard("Set", "t");
+  for (int i = 0; i < 500; i++) {
+    wire.shard("Get", "t").shard("Take", "key-17");
+  }
+  benchWire("tables.get-take", wire, 1000);
+}
+
+void benchMath() {
+  // per element cost of Math kernels on a long homogeneous seq, serial and split across the pool
+  constexpr int Len = 1000000;
+  SeqVar floats;
+  for (int i = 0; i < Len; i++) {
+    floats.push_back(Var(double(i)));
+  }
+  auto serial = shards::Wire("bench-math-multiply").looped(true).let(floats).shard("Math.Multiply", 2.0);
+  benchWire("math.multiply-seq-1m", serial, Len, 20);
+
+  auto parallel = shards::Wire("bench-math-multiply-parallel").looped(true).let(floats).shard("Math.Multiply", 2.0, 65536);
+  benchWire("math.multiply-seq-1m-parallel", parallel, Len, 20);
+}
+
+void benchCompose() {
+  // composing a wire again, as when rescheduled, against a full compose
+  auto wire = shards::Wire("bench-compose");
+  for (int i = 0; i < 100; i++) {
+    wire.let(i).shard("Set", fmt::format("v{}", i)).shard("Get", fmt::format("v{}", i)).shard("Math.Add", 1);
+  }
+
+  SHInstanceData data{};
+  data.wire = wire.get();
+  auto compose = [&]() {
+    auto res = composeWire(
+        wire.get(),
+        [](const Shard *errorShard, const char *errorTxt, bool nonfatalWarning, void *userData) {
+          if (!nonfatalWarning)
+            throw ComposeError(errorTxt);
+        },
+        nullptr, data);
+    arrayFree(res.exposedInfo);
+    arrayFree(res.requiredInfo);
+  };
+
+  auto full = bench("compose.full-400", 1000, 1, [&]() {
+    ComposeCache::clear();
+    compose();
+  });
+  auto memoized = bench("compose.memoized-400", 1000, 1, compose);
+  speedup("compose.memoized-400.speedup", full, memoized);
+}
+
+std::vector<std::pair<std::string_view, OwnedVar>> sampleVars() {
+  std::vector<std::pair<std::string_view, OwnedVar>> vars;
+  vars.emplace_back("Bool", Var(true));
+  vars.emplace_back("Int", Var(10));
+  vars.emplace_back("Int2", Var(1, 2));
+  vars.emplace_back("Int3", Var(1, 2, 3));
+  vars.emplace_back("Int4", Var(1, 2, 3, 4));
+  vars.emplace_back("Int8", Var(int16_t(1), int16_t(2), int16_t(3), int16_t(4), int16_t(5), int16_t(6), int16_t(7), int16_t(8)));
+  vars.emplace_back("Int16", Var(int8_t(1), int8_t(2), int8_t(3), int8_t(4), int8_t(5), int8_t(6), int8_t(7), int8_t(8), int8_t(9),
+                                 int8_t(10), int8_t(11), int8_t(12), int8_t(13), int8_t(14), int8_t(15), int8_t(16)));
+  vars.emplace_back("Float", Var(1.0));
+  vars.emplace_back("Float2", Var(1.0, 2.0));
+  vars.emplace_back("Float3", Var(1.0, 2.0, 3.0));
+  vars.emplace_back("Float4", Var(1.0, 2.0, 3.0, 4.0));
+  vars.emplace_back("Color", Var(SHColor{10, 20, 30, 255}));
+  vars.emplace_back("String", Var("Hello runtime benchmarks"));
+  Var path("bench/runtime/sample.bin");
+  path.valueType = SHType::Path;
+  vars.emplace_back("Path", path);
+  std::vector<uint8_t> bytes(256, 7);
+  vars.emplace_back("Bytes", Var(bytes));
+
+  // vars are cloned when stored, the sources below only need to outlive this function
+  std::vector<uint8_t> pixels(64 * 64 * 4, 127);
+  vars.emplace_back("Image", Var(pixels.data(), 64, 64, 4));
+
+  std::vector<float> samples(512 * 2, 0.5f);
+  vars.emplace_back("Audio", Var(SHAudio{44100, 512, 2, samples.data()}));
+
+  std::vector<SHVarPayload> payloads(64);
+  for (int i = 0; i < 64; i++) {
+    payloads[i].intValue = i;
+  }
+  SHVar array{};
+  array.valueType = SHType::Array;
+  array.innerType = SHType::Int;
+  array.payload.arrayValue.elements = payloads.data();
+  array.payload.arrayValue.len = uint32_t(payloads.size());
+  vars.emplace_back("Array", array);
+
+  SHHashSet hashSet;
+  for (int i = 0; i < 16; i++) {
+    hashSet.insert(Var(i));
+  }
+  SHVar set{};
+  set.valueType = SHType::Set;
+  set.payload.setValue.opaque = &hashSet;
+  set.payload.setValue.api = &GetGlobals().SetInterface;
+  vars.emplace_back("Set", set);
+
+  SeqVar seq;
+  for (int i = 0; i < 16; i++) {
+    seq.push_back(Var(i));
+  }
+  vars.emplace_back("Seq", seq);
+
+  TableVar table{{"a", Var(1)}, {"b", Var(2.0)}, {"c", Var("three")}, {"d", Var(1.0, 2.0, 3.0, 4.0)}};
+  vars.emplace_back("Table", table);
+  return vars;
+}
+
+void benchCloneDestroy() {
+  for (auto &[type, var] : sampleVars()) {
+    SHVar dst{};
+    bench(fmt::format("clone-destroy.{}", type), 100000, 1, [&]() {
+      cloneVar(dst, var);
+      destroyVar(dst);
+    });
+  }
+}
+
+void benchSerialization() {
+  for (auto &[type, var] : sampleVars()) {
+    std::vector<uint8_t> buffer;
+    bench(fmt::format("serialization.{}", type), 10000, 1, [&]() {
+      buffer.clear();
+      Serialization ws;
+      Writer w{buffer};
+      ws.serialize(var, w);
+
+      Serialization rs;
+      Reader r{buffer};
+      SHVar output{};
+      rs.deserialize(r, output);
+      rs.varFree(output);
+    });
+  }
+}
+
+void benchChannels() {
+  // one message goes through per tick
+  auto mesh = SHMesh::make();
+  auto producer = shards::Wire("bench-channel-producer").looped(true).let(1).shard("Produce", "bench-channel");
+  auto consumer = shards::Wire("bench-channel-consumer").looped(true).shard("Consume", "bench-channel");
+  mesh->schedule(producer);
+  mesh->schedule(consumer);
+  bench("channels.produce-consume", 10000, 1, [&]() { mesh->tick(); });
+  mesh->terminate();
+}
+
+#ifndef __EMSCRIPTEN__
+void benchCoroutine() {
+  bool running = true;
+  SHCoro coro = boost::context::callcc(std::allocator_arg, SHStackAllocator{}, [&](SHCoro &&sink) {
+    while (running) {
+      sink = sink.resume();
+    }
+    return std::move(sink);
+  });
+
+  // a resume switches in and back out
+  bench("coroutine.switch", 100000, 2, [&]() { coro = coro.resume(); });
+
+  running = false;
+  coro = coro.resume();
+}
+#endif
+
+void benchMeshTick(const std::vector<uint64_t> &sizes) {
+  for (auto size : sizes) {
+    auto name = fmt::format("mesh.tick.{}", size);
+    try {
+      auto mesh = SHMesh::make();
+      for (uint64_t i = 0; i < size; i++) {
+        auto wire = shards::Wire(fmt::format("bench-mesh-{}", i)).looped(true).stackSize(32 * 1024).let(1);
+        mesh->schedule(wire);
+      }
+      // report the cost of a whole tick, per wire cost is that divided by size
+      bench(name, std::max<uint64_t>(1, 100000 / size), 1, [&]() { mesh->tick(); });
+      mesh->terminate();
+    } catch (const std::exception &e) {
+      // e.g. running out of memory mappings for the stacks
+      failed(name, e);
+    }
+  }
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  shards::GetGlobals().RootPath = "./";
+  shards::registerCoreShards();
+
+  std::string outPath;
+  std::vector<uint64_t> wires{1, 1000};
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg(argv[i]);
+    if ((arg == "--out" || arg == "--wires") && i + 1 >= argc) {
+      SHLOG_ERROR("Missing value for {}", arg);
+      return 1;
+    }
+
+    if (arg == "--out") {
+      outPath = argv[++i];
+    } else if (arg == "--wires") {
+      wires.clear();
+      std::istringstream ss(argv[++i]);
+      std::string item;
+      while (std::getline(ss, item, ',')) {
+        wires.push_back(std::stoull(item));
+      }
+    } else {
+      SHLOG_ERROR("Unknown argument: {}, usage: bench-runtime [--out results.json] [--wires 1,1000]", arg);
+      return 1;
+    }
+  }
+
+  benchActivation();
+  benchVariables();
+  benchTables();
+  benchMath();
+  benchCompose();
+  benchCloneDestroy();
+  benchSerialization();
+  benchChannels();
+#ifndef __EMSCRIPTEN__
+  benchCoroutine();
+#endif
+  benchMeshTick(wires);
+
+  nlohmann::json report = {{"samples", Samples}, {"benchmarks", results}};
+  if (outPath.empty()) {
+    std::cout << report.dump(2) << std::endl;
+  } else {
+    std::ofstream out(outPath);
+    out << report.dump(2) << std::endl;
+  }
+
+  return 0;
+}
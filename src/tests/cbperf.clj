@@ -15,4 +15,17 @@
       (Update "idx")
     ) .nfloats)
     ))))
+; same loop with Get -> Math.Add -> Update fused into one activation
+(schedule Root (Wire "analysis-compiled" :Compiled
+  18000000
+  (Set "nfloats")
+  (Profile (->
+    0 (Set "idx")
+    (Repeat (->
+      (Get "idx")
+      (Math.Add 1)
+      (Update "idx")
+    ) .nfloats)
+    (Get "idx") (Assert.Is 18000000 true)
+    ))))
 (run Root 0.01)
@@ -65,4 +65,49 @@
 (schedule Root consumer33)
 (run Root 0.1)
 
+(def bounded-producer
+  (Wire
+   "BoundedProducer"
+   (Repeat
+    (-> "A message"
+        (Produce "c" :Capacity 2)
+        (Log "Produced bounded: "))
+    10)
+   (Complete "c")))
+
+(def bounded-consumer
+  (Wire
+   "BoundedConsumer"
+   :Looped
+   (Pause 0.1)
+   (Consume "c" 3)
+   (Log "Consumed bounded: ")
+   (Channel.Stats "c")
+   (Log "Channel stats: ")))
+
+(schedule Root bounded-producer)
+(schedule Root bounded-consumer)
+(run Root 0.1)
+
+(def fast-broadcaster
+  (Wire
+   "FastBroadcaster"
+   (Repeat
+    (-> "A message"
+        (Broadcast "d" :Capacity 2 :SlowListener SlowListener.DropOldest))
+    10)
+   (Complete "d")))
+
+(def slow-listener
+  (Wire
+   "SlowListener"
+   :Looped
+   (Listen "d")
+   (Log "Slow listener: ")
+   (Pause 0.1)))
+
+(schedule Root fast-broadcaster)
+(schedule Root slow-listener)
+(run Root 0.1)
+
 (prn "Done")
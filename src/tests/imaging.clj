@@ -30,6 +30,86 @@
   (Log)
   .baseImg
   (ResizeImage 200 200)
-  (WritePNG "testResized.png")))
+  (WritePNG "testResized.png")
+  .baseImg
+  (FilterImage FilterKernel.Gaussian 3 :Border FilterBorder.Mirror)
+  (WritePNG "testGaussian.png")
+  .baseImg
+  (FilterImage FilterKernel.SobelX :Parallel true)
+  (WritePNG "testSobel.png")
+  .baseImg
+  (FilterImage FilterKernel.Custom :Weights [0.25 0.5 0.25] :Border FilterBorder.Zero)
+  (WritePNG "testCustom.png")
+  .baseImg
+  (ImagePyramid 3) >= .mips
+  (Count .mips) (Assert.Is 4 true)
+  .mips (Take 3) (WritePNG "testMip3.png")
+  ;; every level is a plain resize of the one above it, 402x239 halves to 201x119, 100x59 and 50x29
+  .baseImg (ImageToFloats) >= .level0
+  .mips (Take 0) (ImageToFloats) (Assert.Is .level0 true)
+  .baseImg (ResizeImage 201 119) (ImageToFloats) >= .level1
+  .mips (Take 1) (ImageToFloats) (Assert.Is .level1 true)
+  .mips (Take 1) (ResizeImage 100 59) (ImageToFloats) >= .level2
+  .mips (Take 2) (ImageToFloats) (Assert.Is .level2 true)
+  .mips (Take 2) (ResizeImage 50 29) (ImageToFloats) >= .level3
+  .mips (Take 3) (ImageToFloats) (Assert.Is .level3 true)
+  (Repeat (->
+           (LoadImage "../../assets/simple1.PNG" :Cache true)
+           (ResizeImage 64 64)
+           (ResizeImage 64 64))
+          3)))
+
+(schedule
+ Root
+ (Wire
+  "cache"
+  (LoadImage "../../assets/simple1.PNG") (WritePNG "testCache.png")
+  (LoadImage "testCache.png") (ImageToFloats) >= .decoded
+  (LoadImage "testCache.png" :Cache true) (ImageToFloats) (Assert.Is .decoded true)
+  ;; the entry is still held by the shard above, this one is a hit
+  (LoadImage "testCache.png" :Cache true) (ImageToFloats) (Assert.Is .decoded true)
+  ;; some file systems only keep modification times to the second
+  (Pause 1.1)
+  (LoadImage "../../assets/simple1.PNG") (ResizeImage 64 64) (WritePNG "testCache.png")
+  (LoadImage "testCache.png" :Cache true) (ImageToFloats) >= .resized
+  (Count .resized) (Assert.Is (* 64 64 4) true)))
+
+;; pixel checks on 3x3 images, kernels are 3x3 so with Zero borders only the center is untouched
+(defn filter-checks [border]
+  (->
+   .flat (FilterImage FilterKernel.Box 2 :Border border) (ImageToFloats) (Assert.Is .flatFloats true)
+   .flat (FilterImage FilterKernel.Gaussian 2 :Border border) (ImageToFloats) (Assert.Is .flatFloats true)
+   .flat (FilterImage FilterKernel.SobelX :Border border) (ImageToFloats) (Assert.Is .zeroFloats true)
+   .flat (FilterImage FilterKernel.SobelY :Border border) (ImageToFloats) (Assert.Is .zeroFloats true)
+   .ramp (FilterImage FilterKernel.Custom :Weights [0.0 1.0 0.0] :Border border) (ImageToFloats) (Assert.Is .rampFloats true)))
+
+(defn zero-border-checks []
+  (->
+   .flat (FilterImage FilterKernel.Box 2 :Border FilterBorder.Zero) (ImageToFloats) >= .box
+   .box (Take 4) (Assert.Is .flatPixel true)
+   .box (Take 0) (Assert.IsNot .flatPixel true)
+   .flat (FilterImage FilterKernel.Gaussian 2 :Border FilterBorder.Zero) (ImageToFloats) (Take 4) (Assert.Is .flatPixel true)
+   .flat (FilterImage FilterKernel.SobelX :Border FilterBorder.Zero) (ImageToFloats) (Take 4) (Assert.Is 0.0 true)
+   .flat (FilterImage FilterKernel.SobelY :Border FilterBorder.Zero) (ImageToFloats) (Take 4) (Assert.Is 0.0 true)
+   .ramp (FilterImage FilterKernel.Custom :Weights [0.0 1.0 0.0] :Border FilterBorder.Zero) (ImageToFloats) (Assert.Is .rampFloats true)))
+
+(schedule
+ Root
+ (Wire
+  "filters"
+  [0.5 0.5 0.5 0.5 0.5 0.5 0.5 0.5 0.5] (FloatsToImage 3 3 1) >= .flat
+  (ImageToFloats) >= .flatFloats
+  (Take 0) >= .flatPixel
+  [0.0 0.0 0.0 0.0 0.0 0.0 0.0 0.0 0.0] (FloatsToImage 3 3 1) (ImageToFloats) >= .zeroFloats
+  [1.0 0.5 0.0 1.0 0.5 0.0 1.0 0.5 0.0] (FloatsToImage 3 3 1) >= .ramp
+  (ImageToFloats) >= .rampFloats
+  (filter-checks FilterBorder.Clamp)
+  (filter-checks FilterBorder.Wrap)
+  (filter-checks FilterBorder.Mirror)
+  (zero-border-checks)
+  ;; the ramp falls left to right, 8 bit images clip the negative gradient unless asked otherwise
+  .ramp (FilterImage FilterKernel.SobelX) (ImageToFloats) (Take 4) (Assert.Is 0.0 true)
+  .ramp (FilterImage FilterKernel.SobelX :Output FilterOutput.Abs) (ImageToFloats) (Take 4) (Assert.Is 1.0 true)
+  .flat (FilterImage FilterKernel.SobelX :Output FilterOutput.Offset) (ImageToFloats) (Take 4) (Assert.Is (/ 128.0 255.0) true)))
 
 (run Root 0.1)
@@ -139,6 +139,25 @@
   (Float2 20.0 30.0) (Math.Normalize :Positive true) (Log)
   [20.0 30.0] (Math.Normalize :Positive true) (Log)
 
+  ; whole arrays of vectors in one activation
+  [(Float3 1 2 3) (Float3 1 3 4)] (ToArray) >= .points
+  (Math.Cross (Float3 2 2 2)) (ArrayToSeq) (Log)
+  (Assert.Is [(Float3 -2 4 -2) (Float3 -2 6 -4)] true)
+  .points (Math.Dot (Float3 1 5 7)) (ArrayToSeq) (Log)
+  (Assert.Is [32.0 44.0] true)
+  .points (Math.Dot .points) (ArrayToSeq)
+  (Assert.Is [14.0 26.0] true)
+  [(Float3 2 0 0) (Float3 0 0 3)] (ToArray) (Math.Normalize) (ArrayToSeq) (Log)
+  (Assert.Is [(Float3 1 0 0) (Float3 0 0 1)] true)
+  [(Float2 3 4) (Float2 0 2)] (ToArray) (Math.Length) (ArrayToSeq) (Log)
+  (Assert.Is [5.0 2.0] true)
+  (Float3 2 3 4) (Math.Translation) (Math.MatMul .points) (ArrayToSeq) (Log)
+  (Assert.Is [(Float3 3 5 7) (Float3 3 6 8)] true)
+  [(Float4 1 2 3 4)] (ToArray) >= .vectors
+  (Const identity) (Math.MatMul .vectors) (ArrayToSeq)
+  (Assert.Is [(Float4 1 2 3 4)] true)
+  [(Float3 1 2 3) (Float3 1 3 4)] (Math.Length) (Log)
+
   (Msg "Done!")
 ))
 
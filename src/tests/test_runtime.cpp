@@ -1,11 +1,15 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 /* Copyright © 2020 Fragcolor Pte. Ltd. */
 
+#include <cstdio>
+#include <fstream>
 #include <random>
+#include <thread>
 
 #include "../../include/ops.hpp"
 #include "../../include/utility.hpp"
 #include "../core/runtime.hpp"
+#include "../core/shards/math_simd.hpp"
 #include <linalg_shim.hpp>
 
 #undef CHECK
@@ -934,6 +938,79 @@ TEST_CASE("CXX-Wire-DSL") {
   assert(wire->shards.size() == 4);
 }
 
+TEST_CASE("Math-Simd-Padding") {
+  // an Int or Float only fills half of an array payload, results must compare equal
+  // whichever kernel (AVX2, SSE2 or scalar) produced them and whatever the padding holds
+  using namespace shards::Math;
+  constexpr size_t Len = 17;
+  std::vector<SHVarPayload> a(Len), b(Len), fast(Len), slow(Len);
+  memset(fast.data(), 0xAB, Len * sizeof(SHVarPayload));
+  memset(slow.data(), 0xCD, Len * sizeof(SHVarPayload));
+
+  auto array = [](std::vector<SHVarPayload> &payloads, SHType type) {
+    SHVar var{};
+    var.valueType = SHType::Array;
+    var.innerType = type;
+    var.payload.arrayValue.elements = payloads.data();
+    var.payload.arrayValue.len = uint32_t(payloads.size());
+    return var;
+  };
+  auto operands = [&](std::vector<SHVarPayload> &dst, size_t bStride) {
+    return Simd::Operands{reinterpret_cast<uint8_t *>(dst.data()), sizeof(SHVarPayload),
+                          reinterpret_cast<const uint8_t *>(a.data()), sizeof(SHVarPayload),
+                          reinterpret_cast<const uint8_t *>(b.data()), bStride};
+  };
+
+  for (size_t i = 0; i < Len; i++) {
+    a[i].floatValue = double(i);
+    b[i].floatValue = 2.0;
+  }
+  // zeroed padding divides to NaN when computed
+  Simd::run<Simd::Op::Divide>(Simd::Lane::Float, operands(fast, sizeof(SHVarPayload)), Len);
+  Simd::runScalar<Simd::Op::Divide>(Simd::Lane::Float, operands(slow, sizeof(SHVarPayload)), Len);
+  REQUIRE(array(fast, SHType::Float) == array(slow, SHType::Float));
+  REQUIRE_FALSE(array(fast, SHType::Float) < array(slow, SHType::Float));
+  REQUIRE(array(fast, SHType::Float) <= array(slow, SHType::Float));
+
+  // a broadcast operand fills the padding with itself when computed
+  for (size_t i = 0; i < Len; i++) {
+    a[i].intValue = int64_t(i);
+  }
+  b[0].intValue = 7;
+  Simd::run<Simd::Op::Add>(Simd::Lane::Int, operands(fast, 0), Len);
+  Simd::runScalar<Simd::Op::Add>(Simd::Lane::Int, operands(slow, 0), Len);
+  REQUIRE(array(fast, SHType::Int) == array(slow, SHType::Int));
+  slow[Len - 1].intValue++;
+  REQUIRE(array(fast, SHType::Int) != array(slow, SHType::Int));
+  REQUIRE(array(fast, SHType::Int) < array(slow, SHType::Int));
+}
+
+TEST_CASE("Math-Array-Compose") {
+  SeqVar ints;
+  for (int i = 0; i < 4; i++) {
+    ints.push_back(Var(i));
+  }
+  std::vector<SHVarPayload> payloads(4);
+  SHVar floats{};
+  floats.valueType = SHType::Array;
+  floats.innerType = SHType::Float;
+  floats.payload.arrayValue.elements = payloads.data();
+  floats.payload.arrayValue.len = uint32_t(payloads.size());
+
+  auto mesh = SHMesh::make();
+  // both sides of an array operation are checked, whichever is the array
+  auto arrays = shards::Wire("test-math-array-array").let(ints).shard("ToArray").shard("Math.Add", Var(floats));
+  REQUIRE_THROWS_AS(mesh->schedule(arrays), ComposeError);
+  auto arraySeq = shards::Wire("test-math-array-seq").let(ints).shard("ToArray").shard("Math.Add", ints);
+  REQUIRE_THROWS_AS(mesh->schedule(arraySeq), ComposeError);
+  auto seqArray = shards::Wire("test-math-seq-array").let(ints).shard("Math.Add", Var(floats));
+  REQUIRE_THROWS_AS(mesh->schedule(seqArray), ComposeError);
+  auto valid = shards::Wire("test-math-array-int").let(ints).shard("ToArray").shard("Math.Add", 1);
+  mesh->schedule(valid);
+  REQUIRE(mesh->tick());
+  mesh->terminate();
+}
+
 TEST_CASE("DynamicArray") {
   SHSeq ts{};
   Var a{0}, b{1}, c{2}, d{3}, e{4}, f{5};
@@ -1279,3 +1356,560 @@ TEST_CASE("UnsafeActivate-shard") {
   SHVar input{};
   CHECK(b1->activate(b1, nullptr, &input).payload.intValue == 77);
 }
+
+TEST_CASE("Mesh-Workers") {
+  auto mesh = SHMesh::make();
+  mesh->setWorkers(4);
+  REQUIRE(mesh->workers() == 4);
+
+  std::vector<std::shared_ptr<SHWire>> wires;
+  for (int i = 0; i < 64; i++) {
+    auto wire = shards::Wire("test-wire-mesh-worker-" + std::to_string(i))
+                    .looped(true)
+                    .let(i)
+                    .shard("Math.Add", 1)
+                    .shard("Assert.Is", i + 1, true);
+    wires.emplace_back(wire);
+    mesh->schedule(wires.back());
+  }
+
+  // these share a global variable so they are pinned to the same worker
+  auto writer = shards::Wire("test-wire-mesh-worker-writer").looped(true).let(10).shard("Set", "shared", Var::Any, true);
+  auto reader = shards::Wire("test-wire-mesh-worker-reader")
+                    .looped(true)
+                    .shard("Get", "shared", Var::Any, true, 10)
+                    .shard("Assert.Is", 10, true);
+  mesh->schedule(writer);
+  mesh->schedule(reader);
+
+  for (int i = 0; i < 10; i++) {
+    REQUIRE(mesh->tick());
+  }
+
+  uint64_t total = 0;
+  auto ticks = mesh->workerTicks();
+  REQUIRE(ticks.size() == 4);
+  for (auto t : ticks) {
+    total += t;
+  }
+  REQUIRE(total == 66 * 10);
+
+  mesh->terminate();
+  mesh->setWorkers(0);
+  REQUIRE(mesh->workers() == 0);
+}
+
+TEST_CASE("Mesh-Workers-Homes") {
+  auto mesh = SHMesh::make();
+  mesh->setWorkers(4);
+
+  std::vector<std::shared_ptr<SHWire>> wires;
+  for (int i = 0; i < 16; i++) {
+    auto wire = shards::Wire("test-wire-mesh-home-" + std::to_string(i)).looped(true).let(i).shard("Math.Add", 1);
+    wires.emplace_back(wire);
+    mesh->schedule(wires.back());
+  }
+
+  constexpr uint64_t Ticks = 25;
+  for (uint64_t i = 0; i < Ticks; i++) {
+    REQUIRE(mesh->tick());
+  }
+
+  // a wire is resumed by the worker that started it, never stolen after its first tick
+  uint64_t total = 0;
+  for (auto t : mesh->workerTicks()) {
+    REQUIRE(t % Ticks == 0);
+    total += t;
+  }
+  REQUIRE(total == 16 * Ticks);
+
+  mesh->terminate();
+}
+
+TEST_CASE("Channels-Stress") {
+  // bounded so that producers park too, a lost wake up leaves a consumer parked forever
+  auto mesh = SHMesh::make();
+  mesh->setWorkers(4);
+
+  std::vector<std::shared_ptr<SHWire>> wires;
+  for (int i = 0; i < 8; i++) {
+    wires.emplace_back(
+        shards::Wire("test-wire-channel-producer-" + std::to_string(i)).looped(true).let(i).shard("Produce", "stress", false, 4));
+    mesh->schedule(wires.back());
+  }
+
+  std::vector<std::shared_ptr<SHWire>> consumers;
+  for (int i = 0; i < 8; i++) {
+    consumers.emplace_back(shards::Wire("test-wire-channel-consumer-" + std::to_string(i)).shard("Consume", "stress", 500));
+    mesh->schedule(consumers.back());
+  }
+
+  auto done = [&]() {
+    return std::none_of(consumers.begin(), consumers.end(), [](auto &wire) { return shards::isRunning(wire.get()); });
+  };
+  const auto deadline = SHClock::now() + std::chrono::seconds(30);
+  while (!done() && SHClock::now() < deadline) {
+    REQUIRE(mesh->tick());
+  }
+  REQUIRE(done());
+
+  mesh->terminate();
+}
+
+TEST_CASE("Mesh-Deadlines") {
+  auto mesh = SHMesh::make();
+  std::vector<std::shared_ptr<SHWire>> wires;
+  for (int i = 0; i < 100; i++) {
+    auto wire = shards::Wire("test-wire-mesh-deadline-" + std::to_string(i)).looped(true).shard("Pause", 10.0);
+    wires.emplace_back(wire);
+    mesh->schedule(wires.back());
+  }
+
+  // nothing was ticked yet, everything is ready
+  REQUIRE(mesh->nextWakeUp() == SHDuration(0));
+  REQUIRE(mesh->tick());
+
+  // all wires are now paused, the mesh knows when the first will wake up
+  auto now = SHClock::now().time_since_epoch();
+  REQUIRE(mesh->nextWakeUp() > now);
+  REQUIRE(mesh->nextWakeUp() < now + SHDuration(10.0));
+  REQUIRE(mesh->tick());
+  REQUIRE_FALSE(mesh->empty());
+
+  // stopped from outside while asleep, they leave the mesh on next tick instead of at their deadline
+  for (auto &wire : wires) {
+    shards::stop(wire.get());
+  }
+  REQUIRE(mesh->tick());
+  REQUIRE(mesh->empty());
+  REQUIRE(mesh->nextWakeUp() == SHDuration(0));
+
+  // every flow parked, only a wake call can resume them
+  auto producer = shards::Wire("test-wire-mesh-deadline-producer").let(1).shard("Produce", "test-parked");
+  auto consumer = shards::Wire("test-wire-mesh-deadline-consumer").looped(true).shard("Consume", "test-parked", 2);
+  mesh->schedule(producer);
+  mesh->schedule(consumer);
+  REQUIRE(mesh->tick());
+  REQUIRE(mesh->nextWakeUp() == SHDuration::max());
+  // nothing to wait for until then
+  auto waitStart = SHClock::now();
+  mesh->waitForWork(SHClock::now().time_since_epoch() + SHDuration(0.05));
+  REQUIRE(SHClock::now() - waitStart >= SHDuration(0.04));
+  std::thread waker([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    mesh->wake(consumer->context->flow);
+  });
+  mesh->waitForWork(mesh->nextWakeUp());
+  waker.join();
+  REQUIRE(mesh->nextWakeUp() == SHDuration(0));
+  mesh->terminate();
+
+  // a ready wire means no idle time
+  auto busy = shards::Wire("test-wire-mesh-deadline-busy").looped(true).let(1);
+  mesh->schedule(busy);
+  REQUIRE(mesh->nextWakeUp() == SHDuration(0));
+
+  mesh->terminate();
+  REQUIRE(mesh->empty());
+}
+
+#ifndef __EMSCRIPTEN__
+TEST_CASE("Coro-Stack-Pool") {
+  auto &pool = shards::CoroStackPool::instance();
+  auto mesh = SHMesh::make();
+
+  auto wire = shards::Wire("test-wire-stack-pool").let(1).shard("Math.Add", 1);
+  mesh->schedule(wire);
+  REQUIRE(mesh->tick());
+  mesh->terminate();
+
+  // the stack went back to the pool and its usage got recorded
+  REQUIRE(wire->stackHighWater > 0);
+  REQUIRE(wire->stackHighWater <= wire->stackSize);
+
+  auto before = pool.stats();
+  REQUIRE(before.cached > 0);
+
+  auto wire2 = shards::Wire("test-wire-stack-pool-2").let(1).shard("Math.Add", 1);
+  mesh->schedule(wire2);
+  REQUIRE(mesh->tick());
+  mesh->terminate();
+
+  auto after = pool.stats();
+  REQUIRE(after.recycled > before.recycled);
+  REQUIRE(after.mapped == before.mapped);
+
+  // past the guarded limit stacks come from shared slabs, an odd size gets a fresh bucket
+  const auto limit = pool.guardedLimit();
+  pool.setGuardedLimit(0);
+  auto slab = shards::Wire("test-wire-stack-pool-slab").stackSize(200 * 1024).let(1).shard("Math.Add", 1);
+  mesh->schedule(slab);
+  REQUIRE(mesh->tick());
+  REQUIRE(pool.stats().unguarded >= shards::CoroStackPool::SlabStacks);
+  mesh->terminate();
+  REQUIRE(slab->stackHighWater > 0);
+  pool.setGuardedLimit(limit);
+}
+#endif
+
+TEST_CASE("Variable-Slots") {
+  auto mesh = SHMesh::make();
+  auto wire = shards::Wire("test-wire-variable-slots")
+                  .let(1)
+                  .shard("Set", "x")
+                  .shard("Get", "x")
+                  .shard("Math.Add", 1)
+                  .shard("Update", "x")
+                  .shard("Get", "x")
+                  .shard("Assert.Is", 2, true);
+  mesh->schedule(wire);
+  // one slot no matter how many shards use the variable
+  REQUIRE(wire->variableSlots.size() == 1);
+  REQUIRE(mesh->tick());
+  REQUIRE(mesh->errors().size() == 0);
+  mesh->terminate();
+}
+
+TEST_CASE("Mesh-Profiler") {
+  auto mesh = SHMesh::make();
+  mesh->setProfiling(true);
+  auto wire = shards::Wire("test-wire-profiler").looped(true).let(1).shard("Math.Add", 1).shard("Assert.Is", 2, true);
+  mesh->schedule(wire);
+  for (int i = 0; i < 10; i++) {
+    REQUIRE(mesh->tick());
+  }
+
+  std::ostringstream table;
+  mesh->dumpProfile(table, false);
+  REQUIRE(table.str().find("test-wire-profiler;Math.Add@1 10 ") != std::string::npos);
+
+  std::ostringstream collapsed;
+  mesh->dumpProfile(collapsed);
+  std::istringstream lines(collapsed.str());
+  std::string line;
+  int count = 0;
+  while (std::getline(lines, line)) {
+    REQUIRE(line.find("test-wire-profiler;") == 0);
+    count++;
+  }
+  REQUIRE(count == 3);
+
+  mesh->terminate();
+}
+
+TEST_CASE("Wire-Cloner") {
+  auto master = shards::Wire("test-wire-cloner").let(1).shard("Math.Add", 2).shard("Assert.Is", 3, true);
+
+  WireCloner cloner;
+  auto clone = cloner.clone(master.get());
+  REQUIRE(clone->name == master->name);
+  REQUIRE(clone->shards.size() == master->shards.size());
+  for (size_t i = 0; i < clone->shards.size(); i++) {
+    auto a = master->shards[i];
+    auto b = clone->shards[i];
+    REQUIRE(a != b);
+    REQUIRE(std::string(a->name(a)) == b->name(b));
+    for (uint32_t j = 0; j < a->parameters(a).len; j++) {
+      REQUIRE(a->getParam(a, int(j)) == b->getParam(b, int(j)));
+    }
+  }
+
+  auto mesh = SHMesh::make();
+  mesh->schedule(clone);
+  REQUIRE(mesh->tick());
+  mesh->terminate();
+
+  struct Item {
+    std::shared_ptr<SHWire> wire;
+  };
+  struct Composer {
+    void compose(SHWire *wire) {}
+  } composer;
+
+  WireDoppelgangerPool<Item> pool(SHWire::weakRef(master));
+  pool.prewarm(2, composer);
+  REQUIRE(pool.stats().size == 2);
+  REQUIRE(pool.stats().available == 2);
+
+  auto a = pool.acquire(composer);
+  auto b = pool.acquire(composer);
+  auto c = pool.acquire(composer);
+  REQUIRE(pool.stats().hits == 2);
+  REQUIRE(pool.stats().misses == 1);
+  REQUIRE(pool.stats().serialized == 0);
+  REQUIRE(c->wire != a->wire);
+
+  pool.release(c);
+  pool.acquire(composer);
+  REQUIRE(pool.stats().hits == 3);
+}
+
+TEST_CASE("Compose-Cache") {
+  auto make = []() {
+    return shards::Wire("test-wire-compose-cache").let(1).shard("Set", "x").shard("Get", "x").shard("Math.Add", 1);
+  };
+
+  auto a = make();
+  auto b = make();
+  // other tests might have composed the same structure
+  ComposeCache::clear();
+  auto before = ComposeCache::stats();
+
+  auto mesh = SHMesh::make();
+  mesh->schedule(a);
+  auto afterFirst = ComposeCache::stats();
+  REQUIRE(afterFirst.misses == before.misses + 1);
+
+  // another instance with the same structure has its own shards to compose,
+  // but the structure was validated already
+  mesh->schedule(b);
+  auto afterSecond = ComposeCache::stats();
+  REQUIRE(afterSecond.hits == afterFirst.hits + 1);
+  REQUIRE(afterSecond.misses == afterFirst.misses);
+  REQUIRE(afterSecond.memoized == afterFirst.memoized);
+  REQUIRE(b->outputType == a->outputType);
+  REQUIRE(mesh->tick());
+
+  // rescheduling reuses the previous compose
+  mesh->remove(a);
+  mesh->schedule(a);
+  auto afterReschedule = ComposeCache::stats();
+  REQUIRE(afterReschedule.hits == afterSecond.hits + 1);
+  REQUIRE(afterReschedule.memoized == afterSecond.memoized + 1);
+  REQUIRE(afterReschedule.misses == afterSecond.misses);
+
+  // parameters are part of the key
+  a->shards.back()->setParam(a->shards.back(), 0, Var(2));
+  mesh->remove(a);
+  mesh->schedule(a);
+  REQUIRE(ComposeCache::stats().misses == afterReschedule.misses + 1);
+
+  REQUIRE(mesh->tick());
+  mesh->terminate();
+}
+
+TEST_CASE("FS-Read-Large") {
+  // sparse, only the last byte takes space
+  const std::string path = "test-fs-read-large.bin";
+  {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.seekp(std::streamoff(UINT32_MAX));
+    file.put(1);
+  }
+  DEFER(std::remove(path.c_str()));
+
+  auto mesh = SHMesh::make();
+
+  // Bytes lengths are 32 bits, a whole file view would be truncated
+  auto whole = shards::Wire("test-wire-fs-read-large").let(Var(path)).shard("FS.Read", true, true);
+  mesh->schedule(whole);
+  REQUIRE_FALSE(mesh->tick());
+  REQUIRE(mesh->errors().size() == 1);
+
+  // streamed it is fine, mapped or not
+  auto mapped = shards::Wire("test-wire-fs-read-large-mapped").let(Var(path)).shard("FS.Read", true, true, 16);
+  auto streamed = shards::Wire("test-wire-fs-read-large-streamed").let(Var(path)).shard("FS.Read", true, false, 16);
+  mesh->schedule(mapped);
+  mesh->schedule(streamed);
+  REQUIRE(mesh->tick());
+  REQUIRE(mesh->empty());
+
+  mesh->terminate();
+}
+
+TEST_CASE("Serialization-Formats") {
+  SeqVar ints;
+  for (int i = 0; i < 100; i++) {
+    ints.push_back(Var(i - 50));
+  }
+
+  std::vector<uint8_t> v1Buffer;
+  Serialization v1;
+  v1.version = 1;
+  Writer w1{v1Buffer};
+  auto v1Size = v1.serialize(ints, w1);
+  REQUIRE(v1Size == v1Buffer.size());
+
+  std::vector<uint8_t> v2Buffer;
+  Serialization v2;
+  Writer w2{v2Buffer};
+  auto v2Size = v2.serialize(ints, w2);
+  REQUIRE(v2Size == v2Buffer.size());
+  // packed and varint encoded
+  REQUIRE(v2Size * 4 < v1Size);
+
+  SECTION("Legacy") {
+    Var serialized(v1Buffer.data(), v1Buffer.size());
+    Reader r(serialized);
+    Serialization rs;
+    SHVar output{};
+    rs.deserialize(r, output);
+    REQUIRE(output == ints);
+    rs.varFree(output);
+  }
+
+  SECTION("Packed") {
+    Var serialized(v2Buffer.data(), v2Buffer.size());
+    Reader r(serialized);
+    Serialization rs;
+    // recycle a seq of a different type
+    SeqVar strings;
+    strings.push_back(Var("a"));
+    std::vector<uint8_t> stringsBuffer;
+    Writer ws{stringsBuffer};
+    v2.serialize(strings, ws);
+    Var stringsSerialized(stringsBuffer.data(), stringsBuffer.size());
+    Reader rStrings(stringsSerialized);
+    SHVar output{};
+    rs.deserialize(rStrings, output);
+    REQUIRE(output == strings);
+    rs.deserialize(r, output);
+    REQUIRE(output == ints);
+    rs.varFree(output);
+  }
+
+  SECTION("Mixed") {
+    SeqVar mixed;
+    mixed.push_back(Var(1));
+    mixed.push_back(Var(2.0));
+    mixed.push_back(Var("three"));
+    TEST_SERIALIZATION(mixed);
+  }
+}
+
+TEST_CASE("Serialization-Borrowing") {
+  std::vector<uint8_t> large(64 * 1024, 3);
+  std::vector<uint8_t> small(16, 5);
+  SeqVar values;
+  values.push_back(Var(large));
+  values.push_back(Var(small));
+
+  std::vector<uint8_t> buffer;
+  Serialization ws;
+  Writer w{buffer};
+  ws.serialize(values, w);
+  auto source = std::make_shared<std::vector<uint8_t>>(std::move(buffer));
+
+  Serialization rs;
+  BorrowingReader r(source, source->data(), source->size());
+  SHVar output{};
+  rs.deserialize(r, output);
+  REQUIRE(output == values);
+
+  auto &largeView = output.payload.seqValue.elements[0];
+  REQUIRE((largeView.flags & SHVAR_FLAGS_BORROWED) == SHVAR_FLAGS_BORROWED);
+  REQUIRE(largeView.payload.bytesValue >= source->data());
+  REQUIRE(largeView.payload.bytesValue < source->data() + source->size());
+  // small payloads are still copied
+  REQUIRE((output.payload.seqValue.elements[1].flags & SHVAR_FLAGS_BORROWED) == 0);
+
+  // the deserializer keeps the source alive
+  std::weak_ptr<std::vector<uint8_t>> weakSource = source;
+  source.reset();
+  REQUIRE_FALSE(weakSource.expired());
+  REQUIRE(largeView.payload.bytesValue[0] == 3);
+
+  // copying a view owns its memory
+  OwnedVar copy = largeView;
+  REQUIRE((copy.flags & SHVAR_FLAGS_BORROWED) == 0);
+
+  // sources are released on reset
+  rs.varFree(output);
+  rs.reset();
+  REQUIRE(weakSource.expired());
+  REQUIRE(copy == Var(large));
+}
+
+TEST_CASE("String-Storage") {
+  SECTION("Pooled") {
+    uint32_t capacity;
+    auto a = allocString(5, capacity);
+    REQUIRE(capacity == 15);
+    freeString(a, capacity);
+    // recycled on the same thread
+    auto b = allocString(10, capacity);
+    REQUIRE(b == a);
+    freeString(b, capacity);
+
+    auto large = allocString(1000, capacity);
+    REQUIRE(capacity == 1000);
+    freeString(large, capacity);
+
+    OwnedVar s1 = Var("id");
+    REQUIRE(s1.payload.stringCapacity == 15);
+    REQUIRE(s1 == Var("id"));
+  }
+
+  SECTION("Const") {
+    // shards like String.ToUpper write into their input, so constants are never shared
+    std::string longStr(100, 'y');
+    auto shard = createShard("Const");
+    shard->setup(shard);
+    Var param(longStr);
+    shard->setParam(shard, 0, &param);
+    auto value = shard->getParam(shard, 0);
+    OwnedVar copy = value;
+    REQUIRE(copy.payload.stringValue != value.payload.stringValue);
+    shard->destroy(shard);
+    REQUIRE(copy == param);
+  }
+}
+
+TEST_CASE("SHMap-OpenAddressing") {
+  SHMap map;
+  std::vector<SHVar *> cells;
+  for (int i = 0; i < 1000; i++) {
+    auto &cell = map["key-" + std::to_string(i)];
+    cell = Var(i);
+    cells.push_back(&cell);
+  }
+  REQUIRE(map.size() == 1000);
+
+  // growing never moves values
+  for (int i = 0; i < 1000; i++) {
+    REQUIRE(&map["key-" + std::to_string(i)] == cells[i]);
+    REQUIRE(cells[i]->payload.intValue == i);
+  }
+
+  // iteration follows insertion order
+  int expected = 0;
+  for (auto &[key, value] : map) {
+    REQUIRE(key == "key-" + std::to_string(expected));
+    REQUIRE(value.payload.intValue == expected);
+    expected++;
+  }
+  REQUIRE(expected == 1000);
+
+  for (int i = 0; i < 1000; i += 2) {
+    REQUIRE(map.erase("key-" + std::to_string(i)) == 1);
+  }
+  REQUIRE(map.erase("key-0") == 0);
+  REQUIRE(map.size() == 500);
+  REQUIRE(map.count("key-0") == 0);
+  REQUIRE(map.count("key-1") == 1);
+  REQUIRE(cells[999]->payload.intValue == 999);
+
+  // reinserted keys go last
+  map.emplace("key-0", Var(-1));
+  REQUIRE(map.begin()->first == "key-1");
+  auto last = map.begin();
+  for (auto it = map.begin(); it != map.end(); ++it)
+    last = it;
+  REQUIRE(last->first == "key-0");
+
+  // heterogeneous and prehashed lookups
+  std::string_view padded("key-11 and more");
+  auto key = padded.substr(0, 6);
+  auto it = map.find(key, SHMap::hash(key));
+  REQUIRE(it != map.end());
+  REQUIRE(it->second.payload.intValue == 11);
+  REQUIRE(map.find("key-12") == map.end());
+
+  SHMap copy = map;
+  REQUIRE(copy.size() == 501);
+  REQUIRE(copy["key-11"] == Var(11));
+  REQUIRE(&copy["key-11"] != &map["key-11"]);
+  map.clear();
+  REQUIRE(map.size() == 0);
+  REQUIRE(copy.size() == 501);
+}